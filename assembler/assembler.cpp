@@ -1,55 +1,58 @@
+#include <cassert>
+#include <charconv>
+
 #include "assembler.h"
 
 namespace pebble {
 
 template<typename T>
 void Assembler::add_instruction(T instruction) {
-    auto parts = reinterpret_cast<unsigned int*>(&instruction);
-    unsigned int width = sizeof(T) / 4;
-
-    for (size_t i = 0; i < width; i++) {
-        instructions.push_back(parts[i]);
-    }
+    Instruction::encode(instruction, instructions);
 }
 
 unsigned int signed_to_unsigned(int n) {
     return *(unsigned int*) &n;
 }
 
+namespace {
+
+// integer tokens are digits with an optional minus sign, negative numbers wrap around
+unsigned int parse_integer(std::string_view text) {
+    int n = 0;
+    auto result = std::from_chars(text.data(), text.data() + text.size(), n);
+    if (result.ec != std::errc()) {
+        std::cerr << "assembler: invalid integer " << text << "\n";
+        assert(false);
+    }
+    return signed_to_unsigned(n);
+}
+
+}
+
 unsigned int Assembler::get_fp_offset() {
     unsigned int offset = 0;
 
-    if (tokens[token_index + 1].type == TokenType::BracketLeft) {
+    if (lexer.peek().type == TokenType::BracketLeft) {
         expect(TokenType::BracketLeft);
-        auto offset_token = expect(TokenType::Integer);
+        offset = parse_integer(expect(TokenType::Integer).value);
         expect(TokenType::BracketRight);
-
-        if (offset_token.value[0] == '-') {
-            auto string_value = offset_token.value.substr(1);
-            auto n = atoi(string_value.data());
-            offset = n * -1;
-        } else {
-            auto n = atoi(offset_token.value.data());
-            offset = n;
-        }
     }
 
     return offset;
 }
 
-unsigned int Assembler::get_register_index(std::string name) {
-    auto reg = register_by_name_lookup.find(name);
-    if (reg != register_by_name_lookup.end()) {
-        return reg->second;
+unsigned int Assembler::get_register_index(std::string_view name) {
+    if (auto reg = register_keywords.find(name)) {
+        return *reg;
     }
 
     std::cerr << "assembler: invalid register \"" << name << "\"\n";
     assert(false);
 }
 
-InstructionType Assembler::get_instruction(std::string name) {
-    if (auto i = instruction_lookup.find(name); i != instruction_lookup.end()) {
-        return instruction_lookup[name];
+InstructionType Assembler::get_instruction(std::string_view name) {
+    if (auto instruction = instruction_keywords.find(name)) {
+        return *instruction;
     }
 
     std::cerr << "assembler: invalid instruction \"" << name << "\"\n";
@@ -57,11 +60,11 @@ InstructionType Assembler::get_instruction(std::string name) {
 }
 
 Token Assembler::next_token() {
-    return tokens[++token_index];
+    return lexer.next();
 }
 
 Token Assembler::expect(TokenType type) {
-    auto next_token = tokens[++token_index];
+    auto next_token = lexer.next();
     if (next_token.type != type) {
         std::cerr << "assembler: unexpected token " << next_token.value << "\n";
         assert(false);
@@ -69,46 +72,82 @@ Token Assembler::expect(TokenType type) {
     return next_token;
 }
 
-unsigned int Assembler::get_label_address(std::string label) {
-    auto address_entry = labels.find(label);
-    assert(address_entry != labels.end());
-    return address_entry->second;
+Label& Assembler::get_label(std::string_view name) {
+    auto entry = labels.find(name);
+    if (entry == labels.end()) {
+        entry = labels.emplace(name, Label{.id = static_cast<unsigned int>(labels.size())}).first;
+    }
+    return entry->second;
 }
 
-void Assembler::get_labels() {
-    unsigned int current_address = 0;
-    auto current_token = tokens[token_index];
+void Assembler::define_label(std::string_view name) {
+    auto& label = get_label(name);
+    if (label.defined) {
+        std::cerr << "assembler: label \"" << name << "\" is defined twice\n";
+        assert(false);
+    }
 
-    while (current_token.type != TokenType::EndOfFile) {
-        switch (current_token.type) {
-            case TokenType::LabelDefinition: {
-                labels[current_token.value] = current_address;
-                break;
-            }
-            case TokenType::Instruction: {
-                auto instruction = get_instruction(current_token.value);
-                auto width_entry = instruction_width_lookup.find(instruction);
-                assert(width_entry != instruction_width_lookup.end());
-                current_address += instruction_width_lookup.find(instruction)->second;
-                break;
+    label.address = instructions.size();
+    label.defined = true;
+
+    for (auto fixup : label.fixups) {
+        instructions[fixup] = label.address;
+    }
+    label.fixups = {};
+}
+
+// label operands are always the word after the one the instruction starts with
+unsigned int Assembler::reference_label(std::string_view name) {
+    auto& label = get_label(name);
+    auto operand = instructions.size() + 1;
+
+    if (!label.defined) {
+        label.fixups.push_back(operand);
+    }
+    if (relocatable) {
+        relocations.push_back(Relocation{.position = static_cast<unsigned int>(operand), .symbol = label.id});
+    }
+    return label.address;
+}
+
+// every address in a program so far counts the jump to start at the
+// beginning, which is taken out again when there's no start label
+void Assembler::resolve_labels() {
+    for (auto& [name, label] : labels) {
+        if (!label.defined && !(relocatable && label.imported)) {
+            std::cerr << "assembler: label \"" << name << "\" is never defined\n";
+            assert(false);
+        }
+    }
+
+    auto start = labels.find("start");
+    if (relocatable) {
+        // objects start wherever the linker puts them
+    } else if (start != labels.end()) {
+        instructions[1] = start->second.address;
+    } else {
+        unsigned int jump_width = 2;
+        instructions.erase(instructions.begin(), instructions.begin() + jump_width);
+
+        for (unsigned int address = 0; address < instructions.size(); address += Instruction::width(instructions[address])) {
+            if (Instruction::has_address(instructions[address])) {
+                instructions[address + 1] -= jump_width;
             }
-            case TokenType::Label:
-            case TokenType::Register:
-            case TokenType::Integer:
-            case TokenType::Comma:
-            case TokenType::BracketLeft:
-            case TokenType::BracketRight:
-            case TokenType::EndOfFile:
-                // ignore
-                break;
         }
-        current_token = next_token();
+
+        for (auto& [name, label] : labels) {
+            label.address -= jump_width;
+        }
     }
 
-    token_index = 0;
+    symbols.clear();
+    for (auto& [name, label] : labels) {
+        if (label.defined) {
+            symbols.emplace(name, label.address);
+        }
+    }
 }
 
-
 #define ARITHMETIC_LOGIC_ASSEMBLER_CASE(NAME) \
 case InstructionType::NAME: { \
     auto destination_token = expect(TokenType::Register); \
@@ -121,7 +160,7 @@ case InstructionType::NAME: { \
     if (is_register) { \
         source = get_register_index(source_token.value); \
     } else { \
-        source = atoi(source_token.value.data()); \
+        source = parse_integer(source_token.value); \
     } \
     add_instruction(Instruction::NAME{ \
             .destination = destination, \
@@ -131,39 +170,122 @@ case InstructionType::NAME: { \
     break; \
 }
 
-std::vector<unsigned int> Assembler::run(std::string src) {
-    tokens = lexer.get_tokens(src);
-    get_labels();
+// the count is a register or an integer, the addresses are always in a and b
+#define COUNTED_ASSEMBLER_CASE(NAME) \
+case InstructionType::NAME: { \
+    auto count_token = next_token(); \
+    assert(count_token.type == TokenType::Register || count_token.type == TokenType::Integer); \
+    auto is_register = count_token.type == TokenType::Register; \
+    add_instruction(Instruction::NAME{ \
+            .source_type = is_register, \
+            .source = is_register ? get_register_index(count_token.value) : parse_integer(count_token.value), \
+    }); \
+    break; \
+}
+
+std::vector<unsigned int> Assembler::run(std::string_view source) {
+    lexer.start(source);
+    relocatable = false;
+    assemble();
+    return instructions;
+}
 
-    std::cout << "labels before\n";
-    for(auto l : labels) {
-        std::cout << l.first << " - " << l.second << "\n";
+std::vector<unsigned int> Assembler::run(std::istream& source) {
+    lexer.start(source);
+    relocatable = false;
+    assemble();
+    return instructions;
+}
+
+Object Assembler::run_object(std::string_view source) {
+    lexer.start(source);
+    relocatable = true;
+    assemble();
+    return make_object();
+}
+
+Object Assembler::run_object(std::istream& source) {
+    lexer.start(source);
+    relocatable = true;
+    assemble();
+    return make_object();
+}
+
+Object Assembler::make_object() {
+    Object object{.code = instructions, .relocations = std::move(relocations), .data = std::move(data_section)};
+    relocations.clear();
+    data_section = {};
+
+    object.symbols.resize(labels.size());
+    for (auto& [name, label] : labels) {
+        object.symbols[label.id] = ObjectSymbol{
+                .name = name,
+                .address = label.address,
+                .defined = label.defined,
+                // start is where linked programs begin, so it's always visible
+                .exported = label.defined && (label.exported || name == "start")
+        };
     }
+    labels.clear();
 
-    // add jump to entry point if it exists
-    auto start_address_entry = labels.find("start");
-    if (start_address_entry != labels.end()) {
-        // adjust labels to account for jump
-        auto jump_width = instruction_width_lookup.find(InstructionType::Jump);
-        unsigned int w = jump_width->second;
-        for (auto l : labels) {
-            labels.at(l.first) = l.second + w;
-        }
+    return object;
+}
 
-        add_instruction(Instruction::Jump{.address = start_address_entry->second});
+// data <address>, <word>, ... with the address and words as integers
+void Assembler::add_data() {
+    auto address = parse_integer(expect(TokenType::Integer).value);
+
+    std::vector<unsigned int> words;
+    while (lexer.peek().type == TokenType::Comma) {
+        expect(TokenType::Comma);
+        words.push_back(parse_integer(expect(TokenType::Integer).value));
     }
 
-    std::cout << "labels after\n";
-    for(auto l : labels) {
-        std::cout << l.first << " - " << l.second << "\n";
+    if (!data_section.add(address, words)) {
+        std::cerr << "assembler: data at " << address << " overlaps other data or runs past the end of memory\n";
+        assert(false);
     }
+}
+
+void Assembler::assemble() {
+    instructions.clear();
+    data_section = {};
+    labels.clear();
+    relocations.clear();
 
+    // jumps to the entry point, patched once it's known
+    if (!relocatable) {
+        add_instruction(Instruction::Jump{.address = 0});
+    }
 
-    auto current_token = tokens[token_index];
+    auto current_token = next_token();
 
     while (current_token.type != TokenType::EndOfFile) {
         switch (current_token.type) {
             case TokenType::LabelDefinition: {
+                define_label(current_token.value);
+                break;
+            }
+            case TokenType::Directive: {
+                auto directive = *directive_keywords.find(current_token.value);
+                if (directive == Directive::Data) {
+                    add_data();
+                    break;
+                }
+
+                auto label_token = expect(TokenType::Label);
+                auto& label = get_label(label_token.value);
+
+                switch (directive) {
+                    case Directive::Export:
+                        label.exported = true;
+                        break;
+                    case Directive::Import:
+                        label.imported = true;
+                        break;
+                    case Directive::Data:
+                        break;
+                }
                 break;
             }
             case TokenType::Instruction: {
@@ -186,10 +308,8 @@ std::vector<unsigned int> Assembler::run(std::string src) {
 
                         switch (source_token.type) {
                             case TokenType::Label: {
-                                auto address_entry = labels.find(source_token.value);
-                                assert(address_entry != labels.end());
                                 instruction.source_mode = Opcode::AddressingModeAddress;
-                                instruction.source = address_entry->second;
+                                instruction.source = reference_label(source_token.value);
                                 break;
                             }
                             case TokenType::Register: {
@@ -214,10 +334,8 @@ std::vector<unsigned int> Assembler::run(std::string src) {
 
                         switch (destination_token.type) {
                             case TokenType::Label: {
-                                auto address_entry = labels.find(destination_token.value);
-                                assert(address_entry != labels.end());
                                 instruction.destination_mode = Opcode::AddressingModeAddress;
-                                instruction.destination = address_entry->second;
+                                instruction.destination = reference_label(destination_token.value);
                                 break;
                             }
                             case TokenType::Register: {
@@ -245,19 +363,19 @@ std::vector<unsigned int> Assembler::run(std::string src) {
                         Instruction::Move instruction;
 
                         auto destination_token = expect(TokenType::Register);
+                        instruction.destination = get_register_index(destination_token.value);
                         expect(TokenType::Comma);
                         auto source_token = next_token();
                         assert(source_token.type == TokenType::Register || source_token.type == TokenType::Integer);
 
                         auto is_register = source_token.type == TokenType::Register;
 
-                        instruction.destination = get_register_index(destination_token.value);
                         instruction.source_type = is_register;
 
                         if (is_register) {
                             instruction.source = get_register_index(source_token.value);
                         } else {
-                            instruction.source = atoi(source_token.value.data());
+                            instruction.source = parse_integer(source_token.value);
                         }
 
                         add_instruction(instruction);
@@ -284,30 +402,28 @@ std::vector<unsigned int> Assembler::run(std::string src) {
 
                     case InstructionType::Jump: {
                         auto label_token = expect(TokenType::Label);
-                        auto address = get_label_address(label_token.value);
+                        auto address = reference_label(label_token.value);
                         add_instruction(Instruction::Jump{.address = address});
                         break;
                     }
 
                     case InstructionType::JumpIfNonZero: {
                         auto label_token = expect(TokenType::Label);
-                        auto address = get_label_address(label_token.value);
+                        auto address = reference_label(label_token.value);
                         add_instruction(Instruction::JumpIfNonZero{.address = address});
                         break;
                     }
 
                     case InstructionType::JumpIfZero: {
                         auto label_token = expect(TokenType::Label);
-                        auto address = get_label_address(label_token.value);
+                        auto address = reference_label(label_token.value);
                         add_instruction(Instruction::JumpIfZero{.address = address});
                         break;
                     }
 
                     case InstructionType::Call: {
                         auto label_token = expect(TokenType::Label);
-                        auto address_entry = labels.find(label_token.value);
-                        assert(address_entry != labels.end());
-                        add_instruction(Instruction::Call{.address = address_entry->second});
+                        add_instruction(Instruction::Call{.address = reference_label(label_token.value)});
                         break;
                     }
 
@@ -323,7 +439,7 @@ std::vector<unsigned int> Assembler::run(std::string src) {
                         if (is_register) {
                             instruction.source = get_register_index(source_token.value);
                         } else {
-                            instruction.source = atoi(source_token.value.data());
+                            instruction.source = parse_integer(source_token.value);
                         }
 
                         add_instruction(instruction);
@@ -342,6 +458,23 @@ std::vector<unsigned int> Assembler::run(std::string src) {
                         add_instruction(Instruction::Return{});
                         break;
                     }
+
+                    case InstructionType::Native: {
+                        auto index_token = expect(TokenType::Integer);
+                        add_instruction(Instruction::Native{.index = parse_integer(index_token.value)});
+                        break;
+                    }
+
+                    COUNTED_ASSEMBLER_CASE(VectorAdd);
+                    COUNTED_ASSEMBLER_CASE(VectorSubtract);
+                    COUNTED_ASSEMBLER_CASE(VectorMultiply);
+                    COUNTED_ASSEMBLER_CASE(VectorMinimum);
+                    COUNTED_ASSEMBLER_CASE(VectorMaximum);
+                    COUNTED_ASSEMBLER_CASE(VectorSum);
+                    COUNTED_ASSEMBLER_CASE(VectorDot);
+                    COUNTED_ASSEMBLER_CASE(Copy);
+                    COUNTED_ASSEMBLER_CASE(Fill);
+                    COUNTED_ASSEMBLER_CASE(Compare);
                 }
 
                 break;
@@ -361,7 +494,19 @@ std::vector<unsigned int> Assembler::run(std::string src) {
         current_token = next_token();
     }
 
-    return instructions;
+    resolve_labels();
+    if (!relocatable) {
+        // the halt the code runs off onto stays where it is
+        if (!data_section.empty() && data_section.address() <= instructions.size()) {
+            std::cerr << "assembler: data at " << data_section.address() << " overlaps the code\n";
+            assert(false);
+        }
+
+        labels.clear();
+        if (optimizing) {
+            optimize(instructions, symbols);
+        }
+    }
 }
 
 }
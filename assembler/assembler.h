@@ -2,145 +2,100 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <unordered_map>
 
 #include "lexer.h"
+#include "keywords.h"
+#include "object.h"
+#include "optimizer.h"
 #include "../vm/opcode.h"
 #include "../vm/instruction.h"
 #include "../vm/vm.h"
 
 namespace pebble {
 
-enum class InstructionType {
-    Halt,
-    Load,
-    Store,
-    Move,
-    Add,
-    Subtract,
-    Multiply,
-    Divide,
-    Modulo,
-    And,
-    Or,
-    Not,
-    ShiftLeft,
-    ShiftRight,
-    GreaterThan,
-    GreaterThanOrEqualTo,
-    LessThan,
-    LessThanOrEqualTo,
-    EqualTo,
-    NotEqualTo,
-    Jump,
-    JumpIfZero,
-    JumpIfNonZero,
-    Push,
-    Pop,
-    Call,
-    Return,
+// an address, or while a label has only been referenced, the operands
+// waiting for it
+struct Label {
+    // in the order labels first appear, which is their symbol's index in an object
+    unsigned int id = 0;
+    unsigned int address = 0;
+    bool defined = false;
+    bool exported = false;
+    bool imported = false;
+    std::vector<unsigned int> fixups;
 };
 
+// lets labels be found by the views the lexer hands out
+struct LabelHash {
+    using is_transparent = void;
+
+    size_t operator()(std::string_view name) const {
+        return std::hash<std::string_view>{}(name);
+    }
+};
+
+// assembles in one pass, patching references to labels further on once
+// they're defined, so memory grows with the program rather than its source
 class Assembler {
     Lexer lexer;
-    std::vector<Token> tokens;
-    unsigned int token_index = 0;
-
-    std::unordered_map<std::string, Register> register_by_name_lookup = {
-            {"a",  RegisterA},
-            {"b",  RegisterB},
-            {"ip", RegisterIP},
-            {"sp", RegisterSP},
-            {"fp", RegisterFP},
-    };
-
-    std::unordered_map<std::string, InstructionType> instruction_lookup = {
-            {"halt",   InstructionType::Halt},
-            {"load",   InstructionType::Load},
-            {"store",  InstructionType::Store},
-            {"mov",    InstructionType::Move},
-            {"add",    InstructionType::Add},
-            {"sub",    InstructionType::Subtract},
-            {"mul",    InstructionType::Multiply},
-            {"div",    InstructionType::Divide},
-            {"mod",    InstructionType::Modulo},
-            {"and",    InstructionType::And},
-            {"or",     InstructionType::Or},
-            {"shl",    InstructionType::ShiftLeft},
-            {"shr",    InstructionType::ShiftRight},
-            {"eq",     InstructionType::EqualTo},
-            {"jump",   InstructionType::Jump},
-            {"jumpz",  InstructionType::JumpIfZero},
-            {"jumpnz", InstructionType::JumpIfNonZero},
-            {"push",   InstructionType::Push},
-            {"pop",    InstructionType::Pop},
-            {"call",   InstructionType::Call},
-            {"ret",    InstructionType::Return},
-    };
-
-    std::unordered_map<InstructionType, Opcode::Opcode> basic_instruction_lookup = {
-            {InstructionType::Halt,       Opcode::Halt},
-            {InstructionType::Add,        Opcode::Add},
-            {InstructionType::Subtract,   Opcode::Subtract},
-            {InstructionType::Multiply,   Opcode::Multiply},
-            {InstructionType::Divide,     Opcode::Divide},
-            {InstructionType::Modulo,     Opcode::Modulo},
-            {InstructionType::And,        Opcode::And},
-            {InstructionType::Or,         Opcode::Or},
-            {InstructionType::ShiftLeft,  Opcode::ShiftLeft},
-            {InstructionType::ShiftRight, Opcode::ShiftRight},
-            {InstructionType::EqualTo,    Opcode::EqualTo},
-            {InstructionType::Push,       Opcode::Push},
-            {InstructionType::Pop,        Opcode::Pop},
-            {InstructionType::Return,     Opcode::Return}
-    };
-
-    std::unordered_map<InstructionType, unsigned int> instruction_width_lookup = {
-            {InstructionType::Halt,                 sizeof(Instruction::Halt) / 4},
-            {InstructionType::Load,                 sizeof(Instruction::Load) / 4},
-            {InstructionType::Store,                sizeof(Instruction::Store) / 4},
-            {InstructionType::Move,                 sizeof(Instruction::Move) / 4},
-            {InstructionType::Add,                  sizeof(Instruction::Add) / 4},
-            {InstructionType::Subtract,             sizeof(Instruction::Subtract) / 4},
-            {InstructionType::Multiply,             sizeof(Instruction::Multiply) / 4},
-            {InstructionType::Divide,               sizeof(Instruction::Divide) / 4},
-            {InstructionType::Modulo,               sizeof(Instruction::Modulo) / 4},
-            {InstructionType::And,                  sizeof(Instruction::And) / 4},
-            {InstructionType::Or,                   sizeof(Instruction::Or) / 4},
-            {InstructionType::Not,                  sizeof(Instruction::Not) / 4},
-            {InstructionType::ShiftLeft,            sizeof(Instruction::ShiftLeft) / 4},
-            {InstructionType::ShiftRight,           sizeof(Instruction::ShiftRight) / 4},
-            {InstructionType::GreaterThan,          sizeof(Instruction::GreaterThan) / 4},
-            {InstructionType::GreaterThanOrEqualTo, sizeof(Instruction::GreaterThanOrEqualTo) / 4},
-            {InstructionType::LessThan,             sizeof(Instruction::LessThan) / 4},
-            {InstructionType::LessThanOrEqualTo,    sizeof(Instruction::LessThanOrEqualTo) / 4},
-            {InstructionType::EqualTo,              sizeof(Instruction::EqualTo) / 4},
-            {InstructionType::NotEqualTo,           sizeof(Instruction::NotEqualTo) / 4},
-            {InstructionType::Jump,                 sizeof(Instruction::Jump) / 4},
-            {InstructionType::JumpIfZero,           sizeof(Instruction::JumpIfZero) / 4},
-            {InstructionType::JumpIfNonZero,        sizeof(Instruction::JumpIfNonZero) / 4},
-            {InstructionType::Push,                 sizeof(Instruction::Push) / 4},
-            {InstructionType::Pop,                  sizeof(Instruction::Pop) / 4},
-            {InstructionType::Call,                 sizeof(Instruction::Call) / 4},
-            {InstructionType::Return,               sizeof(Instruction::Return) / 4}
-    };
 
     std::vector<unsigned int> instructions;
-    std::unordered_map<std::string, unsigned int> labels;
+    DataSection data_section;
+    std::unordered_map<std::string, Label, LabelHash, std::equal_to<>> labels;
+    // assembling an object rather than a program, see run_object
+    bool relocatable = false;
+    std::vector<Relocation> relocations;
+    bool optimizing;
+    // label addresses once the program is assembled
+    std::unordered_map<std::string, unsigned int> symbols;
     unsigned int get_fp_offset();
-    unsigned int get_register_index(std::string name);
-    InstructionType get_instruction(std::string name);
+    unsigned int get_register_index(std::string_view name);
+    InstructionType get_instruction(std::string_view name);
     Token next_token();
     Token expect(TokenType type);
-    void get_labels();
-    unsigned int get_label_address(std::string label);
+    Label& get_label(std::string_view name);
+    void define_label(std::string_view name);
+    // the label's address, or 0 for now if it isn't defined yet
+    unsigned int reference_label(std::string_view name);
+    void resolve_labels();
+    void add_data();
+    void assemble();
+    Object make_object();
 
     template<typename T>
     void add_instruction(T instruction);
 
 public:
-    std::vector<unsigned int> run(std::string source);
+    // with optimize, programs from run go through optimize, see optimizer.h
+    explicit Assembler(bool optimize = false) : optimizing(optimize) {}
+
+    std::vector<unsigned int> run(std::string_view source);
+    // reads the source a chunk at a time rather than all at once
+    std::vector<unsigned int> run(std::istream& source);
+
+    // assembles a module to be linked with others, see Linker. labels
+    // marked export are visible to the other modules and import ones are
+    // defined by them
+    Object run_object(std::string_view source);
+    Object run_object(std::istream& source);
+
+    // the address of every label in the program from the last run
+    const std::unordered_map<std::string, unsigned int>& label_addresses() const {
+        return symbols;
+    }
+
+    // what the data directives of the last run put in memory, see VM::load
+    const DataSection& data() const {
+        return data_section;
+    }
+
+    // the program from the last run with its labels as symbols and its data, see vm/image.h
+    void write_image(std::ostream& out) const {
+        pebble::write_image(out, instructions, data_section.words(), data_section.address(), symbols);
+    }
 };
 
 }
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <string_view>
+
+#include "../vm/vm.h"
+
+namespace pebble {
+
+enum class InstructionType {
+    Halt,
+    Load,
+    Store,
+    Move,
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Modulo,
+    And,
+    Or,
+    Not,
+    ShiftLeft,
+    ShiftRight,
+    GreaterThan,
+    GreaterThanOrEqualTo,
+    LessThan,
+    LessThanOrEqualTo,
+    EqualTo,
+    NotEqualTo,
+    Jump,
+    JumpIfZero,
+    JumpIfNonZero,
+    Push,
+    Pop,
+    Call,
+    Return,
+    Native,
+    VectorAdd,
+    VectorSubtract,
+    VectorMultiply,
+    VectorMinimum,
+    VectorMaximum,
+    VectorSum,
+    VectorDot,
+    Copy,
+    Fill,
+    Compare,
+};
+
+enum class Directive {
+    // makes a label visible to the modules a program is linked with
+    Export,
+    // declares a label defined by another module
+    Import,
+    // data <address>, <word>, ... puts words in memory past the code before the program starts
+    Data,
+};
+
+template<typename Value>
+struct Keyword {
+    std::string_view name;
+    Value value;
+};
+
+// a perfect hash table over a fixed set of names, built at compile time by
+// trying seeds until every name lands in a slot of its own, so a lookup is
+// one hash and one comparison
+template<typename Value, size_t Count, size_t Slots>
+class KeywordTable {
+    static_assert((Slots & (Slots - 1)) == 0, "the slot count must be a power of two");
+
+    std::array<std::optional<Keyword<Value>>, Slots> slots{};
+    unsigned int seed = 0;
+
+    static constexpr size_t slot(std::string_view name, unsigned int seed) {
+        // fnv-1a from seed
+        auto hash = seed;
+        for (auto c : name) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+        }
+        return (hash ^ (hash >> 16)) & (Slots - 1);
+    }
+
+    constexpr bool place(const std::array<Keyword<Value>, Count>& keywords) {
+        slots = {};
+        for (auto& keyword : keywords) {
+            auto& entry = slots[slot(keyword.name, seed)];
+            if (entry) {
+                return false;
+            }
+            entry = keyword;
+        }
+        return true;
+    }
+
+public:
+    constexpr explicit KeywordTable(const std::array<Keyword<Value>, Count>& keywords) {
+        while (!place(keywords)) {
+            seed++;
+        }
+    }
+
+    constexpr std::optional<Value> find(std::string_view name) const {
+        auto& entry = slots[slot(name, seed)];
+        if (entry && entry->name == name) {
+            return entry->value;
+        }
+        return std::nullopt;
+    }
+};
+
+inline constexpr KeywordTable<InstructionType, 32, 128> instruction_keywords({{
+        {"halt",   InstructionType::Halt},
+        {"load",   InstructionType::Load},
+        {"store",  InstructionType::Store},
+        {"mov",    InstructionType::Move},
+        {"add",    InstructionType::Add},
+        {"sub",    InstructionType::Subtract},
+        {"mul",    InstructionType::Multiply},
+        {"div",    InstructionType::Divide},
+        {"mod",    InstructionType::Modulo},
+        {"and",    InstructionType::And},
+        {"or",     InstructionType::Or},
+        {"shl",    InstructionType::ShiftLeft},
+        {"shr",    InstructionType::ShiftRight},
+        {"eq",     InstructionType::EqualTo},
+        {"jump",   InstructionType::Jump},
+        {"jumpz",  InstructionType::JumpIfZero},
+        {"jumpnz", InstructionType::JumpIfNonZero},
+        {"push",   InstructionType::Push},
+        {"pop",    InstructionType::Pop},
+        {"call",   InstructionType::Call},
+        {"ret",    InstructionType::Return},
+        {"native", InstructionType::Native},
+        {"vadd",   InstructionType::VectorAdd},
+        {"vsub",   InstructionType::VectorSubtract},
+        {"vmul",   InstructionType::VectorMultiply},
+        {"vmin",   InstructionType::VectorMinimum},
+        {"vmax",   InstructionType::VectorMaximum},
+        {"vsum",   InstructionType::VectorSum},
+        {"vdot",   InstructionType::VectorDot},
+        {"bcopy",  InstructionType::Copy},
+        {"bfill",  InstructionType::Fill},
+        {"bcmp",   InstructionType::Compare},
+}});
+
+inline constexpr KeywordTable<Register, 5, 8> register_keywords({{
+        {"a",  RegisterA},
+        {"b",  RegisterB},
+        {"ip", RegisterIP},
+        {"sp", RegisterSP},
+        {"fp", RegisterFP},
+}});
+
+inline constexpr KeywordTable<Directive, 3, 4> directive_keywords({{
+        {"export", Directive::Export},
+        {"import", Directive::Import},
+        {"data",   Directive::Data},
+}});
+
+}
@@ -1,90 +1,162 @@
+#include <array>
+#include <cassert>
 #include <iostream>
 
 #include "lexer.h"
+#include "keywords.h"
 
 namespace pebble {
 
-std::string Lexer::get_text_until_delimiter() {
-    std::string out;
+namespace {
 
-    while (index < source.size() && source[index] != ' ' && source[index] != '\n' && source[index] != ',' &&
-           source[index] != ':' && source[index] != '-' && source[index] != '[' && source[index] != ']') {
-        out += source[index];
-        index++;
+enum CharacterClass : unsigned char {
+    Delimiter = 1,
+    Letter = 2,
+    Digit = 4,
+};
+
+// one lookup per character instead of calls into the locale
+constexpr auto character_classes = [] {
+    std::array<unsigned char, 256> table{};
+    for (unsigned char c : std::string_view(" \n,:-[]")) {
+        table[c] |= Delimiter;
+    }
+    for (int c = 'a'; c <= 'z'; c++) {
+        table[c] |= Letter;
+        table[c - 'a' + 'A'] |= Letter;
     }
+    for (int c = '0'; c <= '9'; c++) {
+        table[c] |= Digit;
+    }
+    return table;
+}();
 
-    return out;
+bool is(char c, CharacterClass character_class) {
+    return character_classes[static_cast<unsigned char>(c)] & character_class;
 }
 
-std::vector<Token> Lexer::get_tokens(std::string src) {
+}
+
+void Lexer::start(std::string_view src) {
+    input = nullptr;
     source = src;
+    index = 0;
+    lookahead.reset();
+}
+
+void Lexer::start(std::istream& src) {
+    input = &src;
+    source = {};
+    index = 0;
+    lookahead.reset();
+}
+
+bool Lexer::refill(size_t& start) {
+    if (!input || !*input) {
+        return false;
+    }
+
+    chunk ^= 1;
+    auto& next = chunks[chunk];
+    next.assign(source.substr(start));
+    auto carried = next.size();
+
+    next.resize(carried + lexer_chunk_size);
+    input->read(next.data() + carried, lexer_chunk_size);
+    next.resize(carried + input->gcount());
+
+    source = next;
+    index -= start;
+    start = 0;
+    return index < source.size();
+}
+
+std::string_view Lexer::get_text_until_delimiter() {
+    auto start = index;
+
+    while (!at_end(start) && !is(source[index], Delimiter)) {
+        index++;
+    }
+
+    return source.substr(start, index - start);
+}
+
+Token Lexer::read() {
+    while (true) {
+        auto start = index;
+        if (at_end(start)) {
+            return Token{.type = TokenType::EndOfFile, .value = ""};
+        }
 
-    while (index < source.size()) {
         auto c = source[index];
         if (c == '&') {
             index++;
             auto val = get_text_until_delimiter();
 
-            TokenType type = TokenType::Label;
-
-            if (source[index] == ':') {
+            auto colon = index;
+            if (!at_end(colon) && source[index] == ':') {
                 index++;
-                type = TokenType::LabelDefinition;
+                return Token{.type = TokenType::LabelDefinition, .value = val};
             }
 
-            tokens.push_back(Token{.type = type, .value = val});
-        } else if (isalpha(c)) {
+            return Token{.type = TokenType::Label, .value = val};
+        } else if (is(c, Letter)) {
             auto val = get_text_until_delimiter();
 
-            if (val == "a" || val == "b" || val == "ip" || val == "sp" || val == "fp") {
-                tokens.push_back(Token{.type = TokenType::Register, .value = val});
-            } else if (instruction_names.find(val) != instruction_names.end()) {
-                tokens.push_back(Token{.type = TokenType::Instruction, .value = val});
-            } else {
-                std::cerr << "lexer: unknown instruction \"" << val << "\"\n";
-                assert(false);
+            if (register_keywords.find(val)) {
+                return Token{.type = TokenType::Register, .value = val};
+            } else if (instruction_keywords.find(val)) {
+                return Token{.type = TokenType::Instruction, .value = val};
+            } else if (directive_keywords.find(val)) {
+                return Token{.type = TokenType::Directive, .value = val};
             }
-            index--;
-        } else if (isnumber(c)) {
-            auto val = get_text_until_delimiter();
-            tokens.push_back(Token{.type = TokenType::Integer, .value = val});
-            index--;
+
+            std::cerr << "lexer: unknown instruction \"" << val << "\"\n";
+            assert(false);
+        } else if (is(c, Digit)) {
+            return Token{.type = TokenType::Integer, .value = get_text_until_delimiter()};
         } else if (c == '-' || c == '+') {
             index++;
-            assert(isnumber(source[index]));
-
-            std::string n;
-            if (c == '-') {
-                n += '-';
+            if (at_end(start) || !is(source[index], Digit)) {
+                std::cerr << "lexer: expected a number after \"" << c << "\"\n";
+                assert(false);
             }
-            while (isnumber(source[index])) {
-                n += source[index];
+
+            while (!at_end(start) && is(source[index], Digit)) {
                 index++;
             }
 
-            tokens.push_back(Token{.type = TokenType::Integer, .value = n});
-            index--;
-
-        } else {
-            switch (c) {
-                case ',':
-                    tokens.push_back(Token{.type = TokenType::Comma, .value = ","});
-                    break;
-                case '[':
-                    tokens.push_back(Token{.type = TokenType::BracketLeft, .value = "["});
-                    break;
-                case ']':
-                    tokens.push_back(Token{.type = TokenType::BracketRight, .value = "]"});
-                    break;
-            }
+            // the sign is part of the value for negative numbers
+            auto value = source.substr(start, index - start);
+            return Token{.type = TokenType::Integer, .value = c == '-' ? value : value.substr(1)};
         }
 
         index++;
+        switch (c) {
+            case ',':
+                return Token{.type = TokenType::Comma, .value = ","};
+            case '[':
+                return Token{.type = TokenType::BracketLeft, .value = "["};
+            case ']':
+                return Token{.type = TokenType::BracketRight, .value = "]"};
+        }
     }
+}
 
-    tokens.push_back(Token{.type = TokenType::EndOfFile, .value = ""});
+Token Lexer::next() {
+    if (lookahead) {
+        auto token = *lookahead;
+        lookahead.reset();
+        return token;
+    }
+    return read();
+}
 
-    return tokens;
+const Token& Lexer::peek() {
+    if (!lookahead) {
+        lookahead = read();
+    }
+    return *lookahead;
 }
 
 }
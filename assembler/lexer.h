@@ -1,47 +1,50 @@
 #pragma once
 
+#include <istream>
+#include <optional>
 #include <string>
-#include <vector>
-#include <set>
+#include <string_view>
 
 #include "token.h"
 
 namespace pebble {
 
+// how much of a streamed source is read at a time
+const size_t lexer_chunk_size = 64 * 1024;
+
+// hands out one token at a time, either from a source already in memory or
+// from a stream read a chunk at a time
+//
+// a token's value points into the source or the chunk it was read from, and
+// stays valid until the token after next has been read
 class Lexer {
-    std::vector<Token> tokens;
-
-    std::string source;
-    int index;
-
-    std::set<std::string> instruction_names = {
-            "halt",
-            "load",
-            "store",
-            "mov",
-            "add",
-            "sub",
-            "mul",
-            "div",
-            "mod",
-            "and",
-            "or",
-            "shl",
-            "shr",
-            "eq",
-            "jump",
-            "jumpz",
-            "jumpnz",
-            "push",
-            "pop",
-            "call",
-            "ret",
-    };
-
-    std::string get_text_until_delimiter();
+    std::istream* input = nullptr;
+    // chunks alternate between the two, so the one before the current
+    // chunk is still there for the tokens read from it
+    std::string chunks[2];
+    unsigned int chunk = 0;
+
+    std::string_view source;
+    size_t index = 0;
+    std::optional<Token> lookahead;
+
+    // reads the next chunk, carrying over what's left of the current one
+    // from start, which is moved along with it. false at the end of input
+    bool refill(size_t& start);
+    // whether the source has run out, reading more first if it's streamed
+    bool at_end(size_t& start) {
+        return index >= source.size() && !refill(start);
+    }
+
+    std::string_view get_text_until_delimiter();
+    Token read();
 
 public:
-    std::vector<Token> get_tokens(std::string src);
+    void start(std::string_view src);
+    void start(std::istream& src);
+
+    Token next();
+    const Token& peek();
 };
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+#include "linker.h"
+#include "../vm/image.h"
+#include "../vm/instruction.h"
+
+namespace pebble {
+
+void Linker::add(Object object) {
+    objects.push_back(std::move(object));
+}
+
+unsigned int Linker::fragment_at(unsigned int object, unsigned int address) const {
+    auto& starts = boundaries[object];
+    auto index = std::upper_bound(starts.begin(), starts.end(), address) - starts.begin() - 1;
+    return first_fragments[object] + index;
+}
+
+// cuts the object's code at each label and finds which fragments end in a
+// jump, return or halt
+void Linker::split(unsigned int object) {
+    auto& code = objects[object].code;
+    auto& starts = boundaries[object];
+
+    starts = {0};
+    for (auto& symbol : objects[object].symbols) {
+        if (symbol.defined) {
+            starts.push_back(symbol.address);
+        }
+    }
+    std::sort(starts.begin(), starts.end());
+    starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+
+    first_fragments[object] = fragments.size();
+    for (size_t i = 0; i < starts.size(); i++) {
+        auto end = i + 1 < starts.size() ? starts[i + 1] : static_cast<unsigned int>(code.size());
+        fragments.push_back(Fragment{.object = object, .start = starts[i], .end = end});
+    }
+
+    for (unsigned int address = 0; address < code.size(); address += Instruction::width(code[address])) {
+        auto opcode = Instruction::opcode(code[address]);
+        fragments[fragment_at(object, address)].falls_through =
+                opcode != Opcode::Jump && opcode != Opcode::Return && opcode != Opcode::Halt;
+    }
+}
+
+unsigned int Linker::linked_address(unsigned int object, unsigned int symbol) const {
+    auto address = objects[object].symbols[symbol].address;
+    auto& fragment = fragments[fragment_at(object, address)];
+    return fragment.address + address - fragment.start;
+}
+
+bool Linker::link() {
+    code.clear();
+    data = {};
+    symbols.clear();
+    fragments.clear();
+    boundaries.assign(objects.size(), {});
+    first_fragments.assign(objects.size(), 0);
+
+    if (objects.empty()) {
+        std::cerr << "linker: nothing to link\n";
+        return false;
+    }
+
+    // which object and symbol defines each exported name
+    std::unordered_map<std::string, std::pair<unsigned int, unsigned int>> exports;
+    for (unsigned int object = 0; object < objects.size(); object++) {
+        auto& object_symbols = objects[object].symbols;
+        for (unsigned int symbol = 0; symbol < object_symbols.size(); symbol++) {
+            if (object_symbols[symbol].defined && object_symbols[symbol].exported &&
+                !exports.emplace(object_symbols[symbol].name, std::make_pair(object, symbol)).second) {
+                std::cerr << "linker: \"" << object_symbols[symbol].name << "\" is exported more than once\n";
+                return false;
+            }
+        }
+        split(object);
+    }
+
+    // where each object's symbols are defined, imports resolved to the object exporting them
+    std::vector<std::vector<std::pair<unsigned int, unsigned int>>> definitions(objects.size());
+    for (unsigned int object = 0; object < objects.size(); object++) {
+        for (unsigned int symbol = 0; symbol < objects[object].symbols.size(); symbol++) {
+            auto& name = objects[object].symbols[symbol].name;
+            if (objects[object].symbols[symbol].defined) {
+                definitions[object].emplace_back(object, symbol);
+            } else if (auto definition = exports.find(name); definition != exports.end()) {
+                definitions[object].push_back(definition->second);
+            } else {
+                std::cerr << "linker: \"" << name << "\" is imported but never exported\n";
+                return false;
+            }
+        }
+
+        for (auto& relocation : objects[object].relocations) {
+            auto [target_object, target_symbol] = definitions[object][relocation.symbol];
+            auto target = fragment_at(target_object, objects[target_object].symbols[target_symbol].address);
+            fragments[fragment_at(object, relocation.position)].targets.push_back(target);
+        }
+    }
+
+    auto start = exports.find("start");
+    auto entry = start != exports.end() ?
+                 fragment_at(start->second.first, objects[start->second.first].symbols[start->second.second].address) : 0;
+
+    std::vector<unsigned int> pending{entry};
+    while (!pending.empty()) {
+        auto index = pending.back();
+        pending.pop_back();
+
+        auto& fragment = fragments[index];
+        if (fragment.live) {
+            continue;
+        }
+        fragment.live = true;
+
+        pending.insert(pending.end(), fragment.targets.begin(), fragment.targets.end());
+        if (fragment.falls_through && index + 1 < fragments.size()) {
+            pending.push_back(index + 1);
+        }
+    }
+
+    // jumps to start, patched once it has an address
+    if (start != exports.end()) {
+        Instruction::encode(Instruction::Jump{.address = 0}, code);
+    }
+
+    for (auto& fragment : fragments) {
+        if (fragment.live) {
+            fragment.address = code.size();
+            auto& object_code = objects[fragment.object].code;
+            code.insert(code.end(), object_code.begin() + fragment.start, object_code.begin() + fragment.end);
+        }
+    }
+
+    for (unsigned int object = 0; object < objects.size(); object++) {
+        for (auto& relocation : objects[object].relocations) {
+            auto& fragment = fragments[fragment_at(object, relocation.position)];
+            if (fragment.live) {
+                auto [target_object, target_symbol] = definitions[object][relocation.symbol];
+                code[fragment.address + relocation.position - fragment.start] = linked_address(target_object, target_symbol);
+            }
+        }
+    }
+
+    if (start != exports.end()) {
+        code[1] = linked_address(start->second.first, start->second.second);
+    }
+
+    for (auto& object : objects) {
+        if (!object.data.empty() && !data.add(object.data.address(), object.data.words())) {
+            std::cerr << "linker: data at " << object.data.address() << " overlaps another object's\n";
+            return false;
+        }
+    }
+    // the halt the code runs off onto stays where it is
+    if (!data.empty() && data.address() <= code.size()) {
+        std::cerr << "linker: data at " << data.address() << " overlaps the code\n";
+        return false;
+    }
+
+    for (auto& [name, definition] : exports) {
+        auto [object, symbol] = definition;
+        if (fragments[fragment_at(object, objects[object].symbols[symbol].address)].live) {
+            symbols.emplace(name, linked_address(object, symbol));
+        }
+    }
+    for (unsigned int object = 0; object < objects.size(); object++) {
+        for (unsigned int symbol = 0; symbol < objects[object].symbols.size(); symbol++) {
+            auto& object_symbol = objects[object].symbols[symbol];
+            if (object_symbol.defined && fragments[fragment_at(object, object_symbol.address)].live) {
+                symbols.emplace(object_symbol.name, linked_address(object, symbol));
+            }
+        }
+    }
+
+    return true;
+}
+
+unsigned long long Linker::removed_words() const {
+    unsigned long long removed = 0;
+    for (auto& fragment : fragments) {
+        if (!fragment.live) {
+            removed += fragment.end - fragment.start;
+        }
+    }
+    return removed;
+}
+
+void Linker::write_image(std::ostream& out) const {
+    pebble::write_image(out, code, data.words(), data.address(), symbols);
+}
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "object.h"
+
+namespace pebble {
+
+// combines objects into one program, keeping only the code that can be
+// reached from where it starts
+//
+// each object's code is cut into fragments at its labels. a fragment is kept
+// if the program starts in it, a kept fragment refers to one of its labels or
+// a kept fragment runs on into it, so the smallest thing dropped is the code
+// between two labels. programs start at the exported label start if there is
+// one and at the beginning of the first object otherwise
+class Linker {
+    struct Fragment {
+        unsigned int object;
+        // in the object's code
+        unsigned int start;
+        unsigned int end;
+        // whether running off the end of it carries on into the next fragment
+        bool falls_through = true;
+        bool live = false;
+        // in the linked program
+        unsigned int address = 0;
+        std::vector<unsigned int> targets;
+    };
+
+    std::vector<Object> objects;
+    std::vector<Fragment> fragments;
+    // the addresses fragments start at in each object, and the index of each one's first fragment
+    std::vector<std::vector<unsigned int>> boundaries;
+    std::vector<unsigned int> first_fragments;
+
+    std::vector<unsigned int> code;
+    DataSection data;
+    std::unordered_map<std::string, unsigned int> symbols;
+
+    unsigned int fragment_at(unsigned int object, unsigned int address) const;
+    void split(unsigned int object);
+    unsigned int linked_address(unsigned int object, unsigned int symbol) const;
+
+public:
+    void add(Object object);
+
+    // false with the reason on stderr if an import isn't exported by any
+    // object, a name is exported more than once or the objects' data overlaps
+    // another's or the code
+    bool link();
+
+    const std::vector<unsigned int>& program() const {
+        return code;
+    }
+
+    // every object's data, which is all kept
+    const DataSection& data_section() const {
+        return data;
+    }
+
+    // the address of every label that was kept, exported ones win where
+    // objects use the same name
+    const std::unordered_map<std::string, unsigned int>& symbol_addresses() const {
+        return symbols;
+    }
+
+    // how many words of the objects' code were left out of the program
+    unsigned long long removed_words() const;
+
+    // the linked program with its symbols and data, see vm/image.h
+    void write_image(std::ostream& out) const;
+};
+
+}
@@ -0,0 +1,117 @@
+#include <fstream>
+#include <iostream>
+
+#include "object.h"
+
+namespace pebble {
+
+namespace {
+
+template<typename T>
+void write_array(std::ostream& out, const std::vector<T>& items) {
+    out.write(reinterpret_cast<const char*>(items.data()), items.size() * sizeof(T));
+}
+
+template<typename T>
+bool read_array(std::istream& in, std::vector<T>& items, unsigned int count) {
+    items.resize(count);
+    in.read(reinterpret_cast<char*>(items.data()), count * sizeof(T));
+    return static_cast<bool>(in);
+}
+
+}
+
+void Object::write(std::ostream& out) const {
+    std::vector<ObjectSymbolEntry> symbol_table;
+    std::string names;
+    for (auto& symbol : symbols) {
+        symbol_table.push_back(ObjectSymbolEntry{
+                .address = symbol.address,
+                .flags = (symbol.defined ? object_symbol_defined : 0) | (symbol.exported ? object_symbol_exported : 0),
+                .name_offset = static_cast<unsigned int>(names.size()),
+                .name_length = static_cast<unsigned int>(symbol.name.size())
+        });
+        names += symbol.name;
+    }
+
+    ObjectHeader header{
+            .magic = object_magic,
+            .version = object_version,
+            .code_size = static_cast<unsigned int>(code.size()),
+            .data_size = static_cast<unsigned int>(data.words().size()),
+            .data_address = data.address(),
+            .symbol_count = static_cast<unsigned int>(symbols.size()),
+            .relocation_count = static_cast<unsigned int>(relocations.size()),
+            .names_size = static_cast<unsigned int>(names.size())
+    };
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    write_array(out, code);
+    write_array(out, data.words());
+    write_array(out, symbol_table);
+    write_array(out, relocations);
+    out.write(names.data(), names.size());
+}
+
+bool Object::read(std::istream& in) {
+    ObjectHeader header{};
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != object_magic) {
+        std::cerr << "linker: not an object\n";
+        return false;
+    }
+
+    if (header.version != object_version) {
+        std::cerr << "linker: object of version " << header.version << ", not " << object_version << "\n";
+        return false;
+    }
+
+    std::vector<ObjectSymbolEntry> symbol_table;
+    std::vector<unsigned int> data_words;
+    std::string names(header.names_size, '\0');
+    if (!read_array(in, code, header.code_size) || !read_array(in, data_words, header.data_size) ||
+        !read_array(in, symbol_table, header.symbol_count) ||
+        !read_array(in, relocations, header.relocation_count) || !in.read(names.data(), names.size())) {
+        std::cerr << "linker: object is truncated\n";
+        return false;
+    }
+
+    data = {};
+    if (!data.add(header.data_address, data_words)) {
+        std::cerr << "linker: object is corrupt\n";
+        return false;
+    }
+
+    symbols.clear();
+    for (auto& entry : symbol_table) {
+        if (entry.name_offset + static_cast<unsigned long long>(entry.name_length) > names.size() ||
+            ((entry.flags & object_symbol_defined) && entry.address > code.size())) {
+            std::cerr << "linker: object is corrupt\n";
+            return false;
+        }
+
+        symbols.push_back(ObjectSymbol{
+                .name = names.substr(entry.name_offset, entry.name_length),
+                .address = entry.address,
+                .defined = (entry.flags & object_symbol_defined) != 0,
+                .exported = (entry.flags & object_symbol_exported) != 0
+        });
+    }
+
+    for (auto& relocation : relocations) {
+        if (relocation.position >= code.size() || relocation.symbol >= symbols.size()) {
+            std::cerr << "linker: object is corrupt\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool is_object(const std::string& file_name) {
+    std::ifstream file(file_name, std::ios::binary);
+    unsigned int magic = 0;
+    file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    return file && magic == object_magic;
+}
+
+}
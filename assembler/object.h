@@ -0,0 +1,82 @@
+#pragma once
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "../vm/image.h"
+
+namespace pebble {
+
+// a module assembled on its own, for Linker to combine with others
+//
+// code is assembled as if it started at address 0, every label operand in
+// it has a relocation naming the symbol it refers to
+struct ObjectSymbol {
+    std::string name;
+    unsigned int address = 0;
+    bool defined = false;
+    // visible to other modules, imports are the symbols that aren't defined
+    bool exported = false;
+};
+
+struct Relocation {
+    // of the operand word in code
+    unsigned int position;
+    // index into symbols
+    unsigned int symbol;
+};
+
+// the file starts with object_magic, then
+//
+//   ObjectHeader
+//   code_size words of code
+//   data_size words of data, for data_address
+//   symbol_count ObjectSymbolEntries
+//   relocation_count Relocations
+//   the symbol names back to back
+//
+// words are in host byte order
+const unsigned int object_magic = 0x424f4250; // "PBOB"
+const unsigned int object_version = 2;
+
+struct ObjectHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int code_size;
+    unsigned int data_size;
+    unsigned int data_address;
+    unsigned int symbol_count;
+    unsigned int relocation_count;
+    unsigned int names_size;
+};
+
+struct ObjectSymbolEntry {
+    unsigned int address;
+    unsigned int flags;
+    // from the first name
+    unsigned int name_offset;
+    unsigned int name_length;
+};
+
+const unsigned int object_symbol_defined = 1 << 0;
+const unsigned int object_symbol_exported = 1 << 1;
+
+struct Object {
+    std::vector<unsigned int> code;
+    std::vector<ObjectSymbol> symbols;
+    std::vector<Relocation> relocations;
+    // at absolute addresses, the linker only checks it doesn't overlap other objects' or the code
+    DataSection data;
+
+    void write(std::ostream& out) const;
+    // false with the reason on stderr if the file isn't an object of this
+    // version or is cut short
+    bool read(std::istream& in);
+};
+
+// whether the file starts with object_magic
+bool is_object(const std::string& file_name);
+
+}
@@ -0,0 +1,400 @@
+#include "optimizer.h"
+#include "../vm/decoder.h"
+#include "../vm/instruction.h"
+#include "../vm/vm.h"
+
+namespace pebble {
+
+namespace {
+
+// passes are run until none of them changes anything, or this many times
+const unsigned int max_passes = 16;
+// how many jumps in a row are followed when threading
+const unsigned int max_jump_chain = 16;
+
+const unsigned int no_op = ~0u;
+
+struct Op {
+    unsigned int opcode;
+    unsigned int destination;
+    unsigned int source;
+    bool has_immediate;
+    bool frame_pointer_offset;
+    // the immediate, an address in the original program for label operands
+    unsigned int operand;
+    // a label or a return address points at it, so control can arrive here from elsewhere
+    bool entry = false;
+    bool removed = false;
+};
+
+bool is_arithmetic_logic(unsigned int opcode) {
+    return opcode >= Opcode::Add && opcode <= Opcode::NotEqualTo && opcode != Opcode::Not;
+}
+
+// whether folding opcode on two constants gives what the VM would, rather
+// than trapping or depending on the host
+bool can_fold(unsigned int opcode, unsigned int right) {
+    switch (opcode) {
+        case Opcode::Divide:
+        case Opcode::Modulo:
+            return right != 0;
+        case Opcode::ShiftLeft:
+        case Opcode::ShiftRight:
+            return right < 32;
+        default:
+            return is_arithmetic_logic(opcode);
+    }
+}
+
+unsigned int fold(unsigned int opcode, unsigned int left, unsigned int right) {
+#define FOLD_CASE(NAME, OPERATOR) \
+    case Opcode::NAME: \
+        return Operation::NAME::apply(left, right);
+
+    switch (opcode) {
+        ARITHMETIC_LOGIC_OPERATIONS(FOLD_CASE)
+    }
+
+#undef FOLD_CASE
+
+    return 0;
+}
+
+// whether running op reads the register
+bool reads(const Op& op, unsigned int r) {
+    switch (op.opcode) {
+        case Opcode::Halt:
+        case Opcode::Jump:
+            return false;
+        case Opcode::Load:
+            return op.frame_pointer_offset && r == RegisterFP;
+        case Opcode::Store:
+            return op.source == r || (op.frame_pointer_offset && r == RegisterFP);
+        case Opcode::Move:
+            return !op.has_immediate && op.source == r;
+        case Opcode::JumpIfZero:
+        case Opcode::JumpIfNonZero:
+            return r == RegisterA;
+        case Opcode::Push:
+            return r == RegisterSP || (!op.has_immediate && op.source == r);
+        case Opcode::Pop:
+        case Opcode::Call:
+        case Opcode::Return:
+            return r == RegisterSP;
+        default:
+            if (is_arithmetic_logic(op.opcode)) {
+                return op.destination == r || (!op.has_immediate && op.source == r);
+            }
+            return true;
+    }
+}
+
+class Optimizer {
+    std::vector<Op> ops;
+    // where each op started in the original program
+    std::vector<unsigned int> addresses;
+    // the op at or after each address of the original program
+    std::vector<unsigned int> op_at;
+
+    unsigned int next(unsigned int i) const {
+        for (i++; i < ops.size(); i++) {
+            if (!ops[i].removed) {
+                return i;
+            }
+        }
+        return no_op;
+    }
+
+    // the op that runs when control arrives at an address of the original program
+    unsigned int live_at(unsigned int address) const {
+        auto i = op_at[address];
+        return i == no_op || !ops[i].removed ? i : next(i);
+    }
+
+    // control arriving at a removed op carries on to the next one
+    void remove(unsigned int i) {
+        ops[i].removed = true;
+        if (auto n = next(i); ops[i].entry && n != no_op) {
+            ops[n].entry = true;
+        }
+    }
+
+    bool thread_jumps();
+    bool remove_unreachable();
+    bool remove_push_pop();
+    bool fold_constants();
+    bool remove_dead_writes();
+
+public:
+    Optimizer(const std::vector<unsigned int>& code, const std::unordered_map<std::string, unsigned int>& labels);
+
+    void run();
+    void write(std::vector<unsigned int>& code, std::unordered_map<std::string, unsigned int>& labels) const;
+};
+
+Optimizer::Optimizer(const std::vector<unsigned int>& code, const std::unordered_map<std::string, unsigned int>& labels)
+        : op_at(code.size() + 1, no_op) {
+    for (unsigned int address = 0; address < code.size(); address += Instruction::width(code[address])) {
+        auto word = code[address];
+        op_at[address] = ops.size();
+        addresses.push_back(address);
+        ops.push_back(Op{
+                .opcode = Instruction::opcode(word),
+                .destination = Instruction::destination(word),
+                .source = Instruction::source(word),
+                .has_immediate = Instruction::has_immediate(word),
+                .frame_pointer_offset = Instruction::addressing_mode(word) == Opcode::AddressingModeFramePointerOffset,
+                .operand = Instruction::has_immediate(word) && address + 1 < code.size() ? code[address + 1] : 0,
+                // calls return to the op after them, and the program starts at the first
+                .entry = ops.empty() || ops.back().opcode == Opcode::Call
+        });
+    }
+
+    for (auto i = code.size(); i-- > 0;) {
+        if (op_at[i] == no_op) {
+            op_at[i] = op_at[i + 1];
+        }
+    }
+
+    for (auto& [name, address] : labels) {
+        if (address < code.size() && op_at[address] != no_op) {
+            ops[op_at[address]].entry = true;
+        }
+    }
+}
+
+// jumps, branches and calls to a jump go straight to where it goes, and
+// jumps and branches to the op after them are taken out
+bool Optimizer::thread_jumps() {
+    auto changed = false;
+
+    for (unsigned int i = 0; i < ops.size(); i++) {
+        auto& op = ops[i];
+        auto is_transfer = op.opcode == Opcode::Jump || op.opcode == Opcode::JumpIfZero ||
+                           op.opcode == Opcode::JumpIfNonZero || op.opcode == Opcode::Call;
+        if (op.removed || !is_transfer || !op.has_immediate || op.operand >= op_at.size()) {
+            continue;
+        }
+
+        auto target = op.operand;
+        for (unsigned int hops = 0; hops < max_jump_chain; hops++) {
+            auto t = live_at(target);
+            if (t == no_op || t == i || ops[t].opcode != Opcode::Jump || !ops[t].has_immediate ||
+                ops[t].operand >= op_at.size() || ops[t].operand == target) {
+                break;
+            }
+            target = ops[t].operand;
+        }
+
+        if (target != op.operand) {
+            op.operand = target;
+            changed = true;
+        }
+
+        if (op.opcode != Opcode::Call && live_at(op.operand) == next(i)) {
+            remove(i);
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+// nothing arrives at the ops after a jump, return or halt until the next entry
+bool Optimizer::remove_unreachable() {
+    auto changed = false;
+
+    for (unsigned int i = 0; i < ops.size(); i++) {
+        auto& op = ops[i];
+        if (op.removed || !(op.opcode == Opcode::Jump || op.opcode == Opcode::Return || op.opcode == Opcode::Halt)) {
+            continue;
+        }
+
+        for (auto n = next(i); n != no_op && !ops[n].entry; n = next(n)) {
+            ops[n].removed = true;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+// push x, pop r is mov r, x, and push r, pop r does nothing
+bool Optimizer::remove_push_pop() {
+    auto changed = false;
+
+    for (unsigned int i = 0; i < ops.size(); i++) {
+        auto& push = ops[i];
+        auto j = next(i);
+        if (push.removed || push.opcode != Opcode::Push || j == no_op) {
+            continue;
+        }
+
+        auto& pop = ops[j];
+        if (pop.opcode != Opcode::Pop || pop.entry || pop.destination == RegisterIP ||
+            (!push.has_immediate && push.source == RegisterIP)) {
+            continue;
+        }
+
+        if (!push.has_immediate && push.source == pop.destination) {
+            remove(i);
+            remove(j);
+        } else {
+            push.opcode = Opcode::Move;
+            push.destination = pop.destination;
+            remove(j);
+        }
+        changed = true;
+    }
+
+    return changed;
+}
+
+// mov r, k followed by an operation on r and a constant becomes one mov
+bool Optimizer::fold_constants() {
+    auto changed = false;
+
+    for (unsigned int i = 0; i < ops.size(); i++) {
+        auto& move = ops[i];
+        if (move.removed || move.opcode != Opcode::Move || !move.has_immediate || move.destination == RegisterIP) {
+            continue;
+        }
+
+        for (auto j = next(i); j != no_op; j = next(i)) {
+            auto& op = ops[j];
+            if (op.entry || op.destination != move.destination || !is_arithmetic_logic(op.opcode) ||
+                (!op.has_immediate && op.source != move.destination)) {
+                break;
+            }
+
+            auto right = op.has_immediate ? op.operand : move.operand;
+            if (!can_fold(op.opcode, right)) {
+                break;
+            }
+
+            move.operand = fold(op.opcode, move.operand, right);
+            remove(j);
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+// writes to a register the next op overwrites without reading it, mov r, r,
+// the second of mov a, b, mov b, a and stores to where the next op stores
+bool Optimizer::remove_dead_writes() {
+    auto changed = false;
+
+    for (unsigned int i = 0; i < ops.size(); i++) {
+        auto& op = ops[i];
+        if (op.removed) {
+            continue;
+        }
+
+        if (op.opcode == Opcode::Move && !op.has_immediate && op.source == op.destination &&
+            op.destination != RegisterIP) {
+            remove(i);
+            changed = true;
+            continue;
+        }
+
+        auto j = next(i);
+        if (j == no_op || ops[j].entry) {
+            continue;
+        }
+        auto& following = ops[j];
+
+        auto writes_only = (op.opcode == Opcode::Move || op.opcode == Opcode::Load) && op.destination != RegisterIP;
+        auto overwrites = (following.opcode == Opcode::Move || following.opcode == Opcode::Load ||
+                           following.opcode == Opcode::Pop) &&
+                          following.destination == op.destination && !reads(following, op.destination);
+        if (writes_only && overwrites) {
+            remove(i);
+            changed = true;
+            continue;
+        }
+
+        auto swaps_back = op.opcode == Opcode::Move && !op.has_immediate &&
+                          following.opcode == Opcode::Move && !following.has_immediate &&
+                          following.destination == op.source && following.source == op.destination &&
+                          op.source != RegisterIP && op.destination != RegisterIP;
+        if (swaps_back) {
+            remove(j);
+            changed = true;
+            continue;
+        }
+
+        auto same_store = op.opcode == Opcode::Store && following.opcode == Opcode::Store &&
+                          op.frame_pointer_offset == following.frame_pointer_offset &&
+                          op.operand == following.operand;
+        if (same_store) {
+            remove(i);
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+void Optimizer::run() {
+    for (unsigned int pass = 0; pass < max_passes; pass++) {
+        // every pass runs, none of them is skipped because an earlier one changed something
+        auto changed = thread_jumps();
+        changed |= remove_unreachable();
+        changed |= remove_push_pop();
+        changed |= fold_constants();
+        changed |= remove_dead_writes();
+        if (!changed) {
+            break;
+        }
+    }
+}
+
+void Optimizer::write(std::vector<unsigned int>& code, std::unordered_map<std::string, unsigned int>& labels) const {
+    // where each op that's kept ends up
+    std::vector<unsigned int> new_addresses(ops.size());
+    unsigned int size = 0;
+    for (unsigned int i = 0; i < ops.size(); i++) {
+        if (!ops[i].removed) {
+            new_addresses[i] = size;
+            size += ops[i].has_immediate ? 2 : 1;
+        }
+    }
+
+    auto relocate = [&](unsigned int address) {
+        auto i = address < op_at.size() ? live_at(address) : no_op;
+        return i == no_op ? size : new_addresses[i];
+    };
+
+    std::vector<unsigned int> optimized;
+    optimized.reserve(size);
+    for (unsigned int i = 0; i < ops.size(); i++) {
+        auto& op = ops[i];
+        if (op.removed) {
+            continue;
+        }
+
+        auto mode = op.frame_pointer_offset ? Opcode::AddressingModeFramePointerOffset : Opcode::AddressingModeAddress;
+        auto word = Instruction::encode(op.opcode, op.destination, op.source, op.has_immediate, mode);
+        optimized.push_back(word);
+        if (op.has_immediate) {
+            optimized.push_back(Instruction::has_address(word) ? relocate(op.operand) : op.operand);
+        }
+    }
+
+    for (auto& [name, address] : labels) {
+        address = relocate(address);
+    }
+    code = std::move(optimized);
+}
+
+}
+
+void optimize(std::vector<unsigned int>& code, std::unordered_map<std::string, unsigned int>& labels) {
+    Optimizer optimizer(code, labels);
+    optimizer.run();
+    optimizer.write(code, labels);
+}
+
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace pebble {
+
+// rewrites an assembled program to run fewer instructions, moving labels
+// along with the code they're on. see Assembler(bool optimize)
+//
+// control is assumed to only arrive at labels and the instructions after
+// calls, so nothing is changed across those. it also assumes the program
+// doesn't read or write its own code as data and doesn't read the stack
+// below sp, where a push and pop that are taken out would have left a value
+void optimize(std::vector<unsigned int>& code, std::unordered_map<std::string, unsigned int>& labels);
+
+}
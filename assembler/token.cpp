@@ -1,3 +1,5 @@
+#include <cassert>
+
 #include "token.h"
 
 namespace pebble {
@@ -6,6 +8,8 @@ std::string get_token_type_string(TokenType type) {
     switch (type) {
         case TokenType::Instruction:
             return "Instruction";
+        case TokenType::Directive:
+            return "Directive";
         case TokenType::Register:
             return "Register";
         case TokenType::Integer:
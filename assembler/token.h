@@ -1,6 +1,7 @@
 #pragma once
 
 #include <ostream>
+#include <string_view>
 
 namespace pebble {
 
@@ -8,6 +9,7 @@ enum class TokenType {
     Label,
     LabelDefinition,
     Instruction,
+    Directive,
     Register,
     Integer,
     Comma,
@@ -16,9 +18,10 @@ enum class TokenType {
     EndOfFile
 };
 
+// value points into the source the lexer was given, which has to outlive the token
 struct Token {
     TokenType type;
-    std::string value;
+    std::string_view value;
 };
 
 std::ostream &operator<<(std::ostream &os, const Token &t);
@@ -0,0 +1,10 @@
+&start:
+    mov a, 2000000
+    mov b, 0
+&loop:
+    add b, 3
+    mul b, 7
+    and b, 65535
+    sub a, 1
+    jumpnz &loop
+    halt
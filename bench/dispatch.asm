@@ -0,0 +1,14 @@
+&start:
+    mov a, 1000000
+&loop:
+    mov b, a
+    mov b, a
+    mov b, a
+    mov b, a
+    mov b, a
+    mov b, a
+    mov b, a
+    mov b, a
+    sub a, 1
+    jumpnz &loop
+    halt
@@ -0,0 +1,36 @@
+&fib:
+    push fp
+    mov fp, sp
+    load a, fp[3]
+    mov b, a
+    eq a, 0
+    jumpnz &fib_base
+    mov a, b
+    eq a, 1
+    jumpnz &fib_base
+    mov a, b
+    sub a, 1
+    push a
+    call &fib
+    pop b
+    push a
+    load a, fp[3]
+    sub a, 2
+    push a
+    call &fib
+    pop b
+    pop b
+    add a, b
+    jump &fib_end
+&fib_base:
+    mov a, b
+&fib_end:
+    pop fp
+    ret
+
+&start:
+    mov fp, sp
+    push 25
+    call &fib
+    pop b
+    halt
@@ -0,0 +1,18 @@
+&start:
+    mov fp, sp
+    push 0
+    push 0
+    push 1000000
+&loop:
+    load a, fp[0]
+    load b, fp[-1]
+    add a, b
+    store fp[0], a
+    load a, fp[-1]
+    add a, 1
+    store fp[-1], a
+    load a, fp[-2]
+    sub a, 1
+    store fp[-2], a
+    jumpnz &loop
+    halt
@@ -0,0 +1,16 @@
+&start:
+    mov a, 1000000
+    mov b, 0
+&loop:
+    push a
+    push b
+    push 3
+    pop b
+    add b, a
+    push b
+    pop b
+    pop b
+    pop a
+    sub a, 1
+    jumpnz &loop
+    halt
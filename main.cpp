@@ -3,38 +3,130 @@
 
 #include "assembler/assembler.h"
 #include "vm/vm.h"
+#include "vm/profiler.h"
 
 int main(int argc, char* argv[]) {
-    if (argc <= 1) {
-        std::cerr << "no file name was provided";
-        return 1;
+    // --ngrams <file> writes the handler pairs the program ran, see pebble_superinstructions
+    std::string ngram_profile_file_name;
+    // --profile <file> writes sampled call stacks in the collapsed format flame graphs are made from
+    std::string stack_profile_file_name;
+    // --memory <words> sets the size of guest memory, --huge-pages backs it with huge pages,
+    // --stack <words> sets how much of the top of it is kept for the stack, 0 to not guard it
+    pebble::MemoryConfig memory;
+    // -o <file> writes the assembled program as an image instead of running it, see vm/image.h,
+    // -c makes it an object to link with others instead, see pebble_link
+    std::string image_file_name;
+    bool object = false;
+    // -O optimizes the program as it's assembled, see assembler/optimizer.h
+    bool optimize = false;
+    int arg = 1;
+
+    while (argc > arg + 1) {
+        std::string option = argv[arg];
+        if (option == "--ngrams") {
+            ngram_profile_file_name = argv[arg + 1];
+            arg += 2;
+        } else if (option == "--profile") {
+            stack_profile_file_name = argv[arg + 1];
+            arg += 2;
+        } else if (option == "--memory") {
+            memory.size = std::stoull(argv[arg + 1]);
+            arg += 2;
+        } else if (option == "--stack") {
+            memory.stack_size = std::stoull(argv[arg + 1]);
+            arg += 2;
+        } else if (option == "-o") {
+            image_file_name = argv[arg + 1];
+            arg += 2;
+        } else if (option == "-O") {
+            optimize = true;
+            arg++;
+        } else if (option == "-c") {
+            object = true;
+            arg++;
+        } else if (option == "--huge-pages") {
+            memory.huge_pages = true;
+            arg++;
+        } else {
+            break;
+        }
     }
 
-    std::string src;
-    std::string line;
-    auto entry_point_file_name = argv[1];
-    std::ifstream entry_point_file(entry_point_file_name);
+    if (memory.size == 0 || memory.size > pebble::max_memory_size) {
+        std::cerr << "memory size must be between 1 and " << pebble::max_memory_size << " words";
+        return 1;
+    }
 
-    if(entry_point_file.fail()) {
-        std::cerr << "failed to open file \"" << entry_point_file_name << "\"";
+    if (argc <= arg) {
+        std::cerr << "no file name was provided";
         return 1;
     }
 
-    // there must be a better way to do this
-    if (entry_point_file.is_open()) {
-        while (getline(entry_point_file, line)) {
-            src += line + '\n';
+    auto entry_point_file_name = argv[arg];
+    pebble::VM vm(pebble::default_engine, memory);
+    std::unordered_map<std::string, unsigned int> symbols;
+
+    if (pebble::is_image(entry_point_file_name)) {
+        pebble::Image image;
+        if (!image.open(entry_point_file_name)) {
+            return 1;
+        }
+
+        if (!vm.load(image)) {
+            return 1;
+        }
+        symbols = image.symbols();
+    } else {
+        std::ifstream entry_point_file(entry_point_file_name);
+
+        if (entry_point_file.fail()) {
+            std::cerr << "failed to open file \"" << entry_point_file_name << "\"";
+            return 1;
         }
-        entry_point_file.close();
+
+        pebble::Assembler assembler(optimize);
+
+        if (object) {
+            if (image_file_name.empty()) {
+                std::cerr << "-c needs an output file, given with -o";
+                return 1;
+            }
+
+            std::ofstream object_file(image_file_name, std::ios::binary);
+            assembler.run_object(entry_point_file).write(object_file);
+            return object_file.good() ? 0 : 1;
+        }
+
+        auto bytecode = assembler.run(entry_point_file);
+
+        if (!image_file_name.empty()) {
+            std::ofstream image_file(image_file_name, std::ios::binary);
+            assembler.write_image(image_file);
+            return image_file.good() ? 0 : 1;
+        }
+
+        vm.load(bytecode, assembler.data());
+        symbols = assembler.label_addresses();
     }
 
-    pebble::VM vm;
-    pebble::Assembler assembler;
+    if (!ngram_profile_file_name.empty()) {
+        pebble::NgramProfile profile;
+        vm.run_profiled(profile);
 
-    auto bytecode = assembler.run(src);
+        std::ofstream profile_file(ngram_profile_file_name);
+        profile.write(profile_file);
+        return 0;
+    }
 
-    vm.load(bytecode);
-    vm.run();
+    if (!stack_profile_file_name.empty()) {
+        pebble::Profiler profiler;
+        profiler.add_symbols(symbols);
+        profiler.run(vm);
+
+        std::ofstream profile_file(stack_profile_file_name);
+        profiler.write(profile_file);
+        return 0;
+    }
 
-    return 0;
+    return vm.run() == pebble::RunStatus::Faulted ? 1 : 0;
 }
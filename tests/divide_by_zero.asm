@@ -0,0 +1,11 @@
+&start:
+    mov a, 10
+    push a
+    mov b, 0
+&loop:
+    push b
+    add b, 1
+    sub a, 1
+    jumpnz &loop
+    div b, a
+    halt
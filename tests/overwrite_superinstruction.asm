@@ -0,0 +1,9 @@
+&start:
+    mov sp, 7
+    mov a, 0
+    push a
+    call &f
+    halt
+&f:
+    mov b, 7
+    halt
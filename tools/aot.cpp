@@ -0,0 +1,434 @@
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../assembler/assembler.h"
+#include "../vm/decoder.h"
+
+// translates a pebble program into a C++ translation unit defining a
+// pebble::AotProgram, see vm/aot.h
+//
+// every basic block becomes straight-line code on local copies of the
+// registers and the state's memory. jumps and calls to known blocks are
+// gotos, returns and jumps through ip go through a switch over the blocks.
+// native calls, vector and block instructions and anything else the decoder
+// leaves generic run one at a time on a VM, see aot_execute. anything else
+// that can't be translated hands the rest of the run over to the VM: addresses
+// that aren't the start of a block, division by zero and writes into the
+// program itself
+//
+// programs ending in .asm are assembled first, images (see vm/image.h) have
+// their code and data read and anything else is read as raw 32-bit words
+//
+// usage: pebble_aot [-n name] [-o output] <program>
+
+using namespace pebble;
+
+namespace {
+
+const char* register_names[] = {"a", "b", "ip", "sp", "fp"};
+
+struct Translator {
+    const std::vector<unsigned int>& code;
+    // put in memory at data_address before the program runs, see aot_load
+    const std::vector<unsigned int>& data;
+    unsigned int data_address;
+    std::ostream& out;
+    std::set<unsigned int> block_starts;
+    bool halts = false;
+
+    unsigned int code_size() const {
+        return code.size();
+    }
+
+    static std::string constant(unsigned int value) {
+        return std::to_string(value) + "u";
+    }
+
+    std::string jump_to(unsigned int address) const {
+        if (block_starts.contains(address)) {
+            return "goto block_" + std::to_string(address) + ";";
+        }
+        return "pc = " + constant(address) + "; goto dispatch;";
+    }
+
+    static std::string interpret_from(unsigned int address) {
+        return "pc = " + constant(address) + "; goto interpret;";
+    }
+
+    // a write into the program has to be seen by the decoder, so the VM runs the rest
+    void write_check(const std::string& address, unsigned int next) const {
+        out << "    if (" << address << " <= code_size) { " << interpret_from(next) << " }\n";
+    }
+
+    // the state holds the registers while the VM runs an instruction, see aot_execute
+    void save_registers(unsigned int pc) const {
+        for (auto name : register_names) {
+            out << "        state." << name << " = " << (name == std::string("ip") ? constant(pc) : name) << ";\n";
+        }
+    }
+
+    void load_registers() const {
+        for (auto name : register_names) {
+            out << "        " << (name == std::string("ip") ? "pc" : name) << " = state." << name << ";\n";
+        }
+    }
+
+    void find_block_starts();
+    void translate(unsigned int address, const DecodedInstruction& i);
+    void run(const std::string& name, const std::string& source_name);
+};
+
+void Translator::find_block_starts() {
+    block_starts.insert(0);
+
+    for (unsigned int address = 0; address < code_size();) {
+        auto i = decode(code.data(), address, code_size());
+        auto next = address + i.width;
+
+        switch (i.handler) {
+            case Handler::Jump:
+            case Handler::JumpIfZero:
+            case Handler::JumpIfNonZero:
+            case Handler::Call:
+                block_starts.insert(i.operand);
+                block_starts.insert(next);
+                break;
+            // generic instructions may jump anywhere, and native calls come
+            // back through dispatch the same, see aot_execute
+            case Handler::Halt:
+            case Handler::Return:
+            case Handler::Generic:
+            case Handler::Native:
+                block_starts.insert(next);
+                break;
+            default:
+                break;
+        }
+
+        address = next;
+    }
+
+    // only addresses the sweep decodes an instruction at can start a block
+    std::set<unsigned int> starts;
+    for (unsigned int address = 0; address < code_size(); address += decode(code.data(), address, code_size()).width) {
+        if (block_starts.contains(address)) {
+            starts.insert(address);
+        }
+    }
+    block_starts = starts;
+}
+
+#define ARITHMETIC_LOGIC_OPERATION_TRANSLATION(NAME, OPERATOR) \
+case Handler::NAME##Register: \
+    out << "    " << reg << " = " << reg << " " #OPERATOR " " << register_names[i.operand] << ";\n"; \
+    break; \
+case Handler::NAME##Immediate: \
+    out << "    " << reg << " = " << reg << " " #OPERATOR " " << constant(i.operand) << ";\n"; \
+    break;
+
+void Translator::translate(unsigned int address, const DecodedInstruction& i) {
+    auto next = address + i.width;
+    auto reg = register_names[i.reg < NumRegisters ? i.reg : 0];
+
+    out << "    // " << address << ": " << handler_name(i.handler) << "\n";
+
+    // the VM faults on a zero divisor where the host would trap
+    switch (i.handler) {
+        case Handler::DivideRegister:
+        case Handler::ModuloRegister:
+            out << "    if (" << register_names[i.operand] << " == 0) { " << interpret_from(address) << " }\n";
+            break;
+        case Handler::DivideImmediate:
+        case Handler::ModuloImmediate:
+            if (i.operand == 0) {
+                out << "    " << interpret_from(address) << "\n";
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+
+    switch (i.handler) {
+        case Handler::LoadAddress:
+            out << "    " << reg << " = pebble::load_shared(m[" << constant(i.operand) << "]);\n";
+            break;
+
+        case Handler::LoadFramePointerOffset:
+            out << "    " << reg << " = pebble::load_shared(m[fp + " << constant(i.operand) << "]);\n";
+            break;
+
+        case Handler::StoreAddress:
+            out << "    pebble::store_shared(m[" << constant(i.operand) << "], " << reg << ");\n";
+            if (i.operand <= code_size()) {
+                out << "    " << interpret_from(next) << "\n";
+            }
+            break;
+
+        case Handler::StoreFramePointerOffset:
+            out << "    {\n";
+            out << "        unsigned int address = fp + " << constant(i.operand) << ";\n";
+            out << "        pebble::store_shared(m[address], " << reg << ");\n";
+            out << "    ";
+            write_check("address", next);
+            out << "    }\n";
+            break;
+
+        case Handler::MoveRegister:
+            out << "    " << reg << " = " << register_names[i.operand] << ";\n";
+            break;
+
+        case Handler::MoveImmediate:
+            out << "    " << reg << " = " << constant(i.operand) << ";\n";
+            break;
+
+        ARITHMETIC_LOGIC_OPERATIONS(ARITHMETIC_LOGIC_OPERATION_TRANSLATION)
+
+        // the register form inverts the destination, the same as VM::execute
+        case Handler::NotRegister:
+            out << "    " << reg << " = ~" << reg << ";\n";
+            break;
+
+        case Handler::NotImmediate:
+            out << "    " << reg << " = " << constant(~i.operand) << ";\n";
+            break;
+
+        case Handler::PushRegister:
+            out << "    m[sp--] = " << reg << ";\n";
+            write_check("sp + 1", next);
+            break;
+
+        case Handler::PushImmediate:
+            out << "    m[sp--] = " << constant(i.operand) << ";\n";
+            write_check("sp + 1", next);
+            break;
+
+        case Handler::Pop:
+            out << "    " << reg << " = m[++sp];\n";
+            break;
+
+        case Handler::Halt:
+            halts = true;
+            out << "    pc = " << constant(address) << "; goto halt;\n";
+            break;
+
+        case Handler::Jump:
+            out << "    " << jump_to(i.operand) << "\n";
+            break;
+
+        case Handler::JumpIfZero:
+            out << "    if (a == 0) { " << jump_to(i.operand) << " }\n";
+            out << "    " << jump_to(next) << "\n";
+            break;
+
+        case Handler::JumpIfNonZero:
+            out << "    if (a != 0) { " << jump_to(i.operand) << " }\n";
+            out << "    " << jump_to(next) << "\n";
+            break;
+
+        case Handler::Call:
+            out << "    m[sp--] = " << constant(next) << ";\n";
+            write_check("sp + 1", i.operand);
+            out << "    " << jump_to(i.operand) << "\n";
+            break;
+
+        case Handler::Return:
+            out << "    pc = m[++sp]; goto dispatch;\n";
+            break;
+
+        case Handler::Native:
+        case Handler::Generic:
+            out << "    {\n";
+            save_registers(address);
+            out << "        auto next = pebble::aot_execute(state);\n";
+            load_registers();
+            out << "        if (next == pebble::AotNext::Stop) { return; }\n";
+            out << "        if (next == pebble::AotNext::Interpret) { goto interpret; }\n";
+            out << "    }\n";
+            out << "    goto dispatch;\n";
+            break;
+
+        default:
+            out << "    " << interpret_from(address) << "\n";
+            break;
+    }
+}
+
+void Translator::run(const std::string& name, const std::string& source_name) {
+    find_block_starts();
+
+    out << "// generated by pebble_aot from " << source_name << ", do not edit\n\n";
+    out << "#include \"vm/aot.h\"\n\n";
+    out << "namespace {\n\n";
+
+    out << "const unsigned int code[] = {";
+    for (unsigned int address = 0; address < code_size(); address++) {
+        out << (address % 8 ? " " : "\n        ") << constant(code[address]) << ",";
+    }
+    out << "\n};\n\n";
+
+    out << "const unsigned int code_size = " << constant(code_size()) << ";\n\n";
+
+    // an array can't be empty
+    if (data.empty()) {
+        out << "const unsigned int* const data = nullptr;\n";
+    } else {
+        out << "const unsigned int data[] = {";
+        for (unsigned int i = 0; i < data.size(); i++) {
+            out << (i % 8 ? " " : "\n        ") << constant(data[i]) << ",";
+        }
+        out << "\n};\n";
+    }
+    out << "const unsigned int data_size = " << constant(data.size()) << ";\n";
+    out << "const unsigned int data_address = " << constant(data_address) << ";\n\n";
+
+    out << "void run(pebble::AotState& state) {\n";
+    out << "    auto m = state.memory.data();\n";
+    out << "    unsigned int a = state.a;\n";
+    out << "    unsigned int b = state.b;\n";
+    out << "    unsigned int sp = state.sp;\n";
+    out << "    unsigned int fp = state.fp;\n";
+    out << "    unsigned int pc = state.ip;\n";
+    out << "    goto dispatch;\n\n";
+
+    out << "dispatch:\n";
+    out << "    switch (pc) {\n";
+    for (auto start : block_starts) {
+        out << "        case " << constant(start) << ": goto block_" << start << ";\n";
+    }
+    out << "        default: goto interpret;\n";
+    out << "    }\n";
+
+    for (unsigned int address = 0; address < code_size();) {
+        auto i = decode(code.data(), address, code_size());
+
+        if (block_starts.contains(address)) {
+            out << "\nblock_" << address << ":\n";
+        }
+
+        translate(address, i);
+        address += i.width;
+    }
+
+    // the last block runs on into whatever follows the program
+    out << "    " << interpret_from(code_size()) << "\n\n";
+
+    if (halts) {
+        out << "halt:\n";
+        out << "    state.a = a;\n";
+        out << "    state.b = b;\n";
+        out << "    state.sp = sp;\n";
+        out << "    state.fp = fp;\n";
+        out << "    state.ip = pc;\n";
+        out << "    return;\n\n";
+    }
+
+    out << "interpret:\n";
+    out << "    state.a = a;\n";
+    out << "    state.b = b;\n";
+    out << "    state.sp = sp;\n";
+    out << "    state.fp = fp;\n";
+    out << "    state.ip = pc;\n";
+    out << "    pebble::aot_interpret(state);\n";
+    out << "}\n\n";
+
+    out << "}\n\n";
+
+    out << "extern const pebble::AotProgram " << name << " = {code, code_size, data, data_size, data_address, run};\n";
+}
+
+// the file name without directories or extension, made into an identifier
+std::string program_name(const std::string& file_name) {
+    auto name = file_name.substr(file_name.find_last_of('/') + 1);
+    name = name.substr(0, name.find('.'));
+
+    for (auto& c : name) {
+        if (!isalnum(c)) {
+            c = '_';
+        }
+    }
+
+    if (name.empty() || isdigit(name[0])) {
+        name = "_" + name;
+    }
+
+    return name;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    std::string name;
+    std::string output_file_name;
+    std::string input_file_name;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc) {
+            name = argv[++i];
+        } else if (arg == "-o" && i + 1 < argc) {
+            output_file_name = argv[++i];
+        } else {
+            input_file_name = arg;
+        }
+    }
+
+    if (input_file_name.empty()) {
+        std::cerr << "usage: pebble_aot [-n name] [-o output] <program>\n";
+        return 1;
+    }
+
+    if (name.empty()) {
+        name = program_name(input_file_name);
+    }
+
+    std::ifstream input_file(input_file_name, std::ios::binary);
+    if (input_file.fail()) {
+        std::cerr << "failed to open file \"" << input_file_name << "\"\n";
+        return 1;
+    }
+
+    std::vector<unsigned int> code;
+    std::vector<unsigned int> data;
+    unsigned int data_address = 0;
+
+    if (input_file_name.ends_with(".asm")) {
+        Assembler assembler;
+        code = assembler.run(input_file);
+        data = assembler.data().words();
+        data_address = assembler.data().address();
+    } else if (is_image(input_file_name)) {
+        Image image;
+        if (!image.open(input_file_name)) {
+            return 1;
+        }
+        code.assign(image.code(), image.code() + image.header().code_size);
+        data.assign(image.data(), image.data() + image.header().data_size);
+        data_address = image.header().data_address;
+    } else {
+        unsigned int word;
+        while (input_file.read(reinterpret_cast<char*>(&word), sizeof(word))) {
+            code.push_back(word);
+        }
+    }
+
+    std::ofstream output_file;
+    if (!output_file_name.empty()) {
+        output_file.open(output_file_name);
+        if (output_file.fail()) {
+            std::cerr << "failed to open file \"" << output_file_name << "\"\n";
+            return 1;
+        }
+    }
+
+    std::ostream& out = output_file_name.empty() ? std::cout : output_file;
+
+    Translator translator{code, data, data_address, out};
+    translator.run(name, input_file_name.substr(input_file_name.find_last_of('/') + 1));
+
+    return 0;
+}
@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../assembler/assembler.h"
+#include "../vm/vm.h"
+
+// runs programs on each engine and reports how quickly VM::run gets through them
+//
+// usage: pebble_bench [-r repetitions] [-e switch|threaded|jit] [program.asm]...
+//
+// with no programs it runs the corpus in bench/. times are the fastest of the
+// repetitions after a warm-up run and only cover VM::run, not loading.
+// dispatch.asm does little but dispatch, so its time per instruction is
+// reported as the engine's dispatch overhead, and as a share of each program's
+// time per instruction
+
+struct Program {
+    std::string name;
+    std::vector<unsigned int> code;
+    unsigned long long instructions = 0;
+};
+
+struct EngineName {
+    pebble::Engine engine;
+    std::string name;
+};
+
+const std::vector<EngineName> engines = {
+        {pebble::Engine::Switch,   "switch"},
+        {pebble::Engine::Threaded, "threaded"},
+        {pebble::Engine::Jit,      "jit"},
+};
+
+bool assemble(const std::string& file_name, std::vector<unsigned int>& code) {
+    std::ifstream file(file_name);
+    if (file.fail()) {
+        return false;
+    }
+
+    pebble::Assembler assembler;
+    code = assembler.run(file);
+
+    return true;
+}
+
+// the switch engine checks the budget before every instruction and any
+// instruction uses up a budget of one word, so each run runs exactly one
+unsigned long long count_instructions(const std::vector<unsigned int>& code) {
+    pebble::VM vm(pebble::Engine::Switch);
+    vm.load(code);
+
+    unsigned long long count = 1;
+    while (vm.run(1) == pebble::RunStatus::OutOfFuel) {
+        count++;
+    }
+
+    return count;
+}
+
+// in seconds
+double run_once(pebble::Engine engine, const std::vector<unsigned int>& code) {
+    pebble::VM vm(engine);
+    vm.load(code);
+
+    auto start = std::chrono::steady_clock::now();
+    vm.run();
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double>(end - start).count();
+}
+
+double fastest_run(pebble::Engine engine, const std::vector<unsigned int>& code, unsigned int repetitions) {
+    run_once(engine, code);
+
+    auto fastest = run_once(engine, code);
+    for (unsigned int i = 1; i < repetitions; i++) {
+        fastest = std::min(fastest, run_once(engine, code));
+    }
+
+    return fastest;
+}
+
+int main(int argc, char* argv[]) {
+    unsigned int repetitions = 5;
+    std::vector<EngineName> selected_engines;
+    std::vector<std::string> file_names;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-r" && i + 1 < argc) {
+            repetitions = std::max(std::stoul(argv[++i]), 1ul);
+        } else if (arg == "-e" && i + 1 < argc) {
+            std::string name = argv[++i];
+            auto engine = std::find_if(engines.begin(), engines.end(), [&](auto& e) { return e.name == name; });
+            if (engine == engines.end()) {
+                std::cerr << "unknown engine \"" << name << "\"\n";
+                return 1;
+            }
+            selected_engines.push_back(*engine);
+        } else {
+            file_names.push_back(arg);
+        }
+    }
+
+    if (selected_engines.empty()) {
+        selected_engines = engines;
+    }
+
+    if (file_names.empty()) {
+        for (auto& entry : std::filesystem::directory_iterator(PEBBLE_BENCH_DIR)) {
+            if (entry.path().extension() == ".asm") {
+                file_names.push_back(entry.path().string());
+            }
+        }
+        std::sort(file_names.begin(), file_names.end());
+    }
+
+    if (file_names.empty()) {
+        std::cerr << "usage: pebble_bench [-r repetitions] [-e switch|threaded|jit] [program.asm]...\n";
+        return 1;
+    }
+
+    std::vector<Program> programs;
+    for (auto& file_name : file_names) {
+        Program program{std::filesystem::path(file_name).stem().string()};
+        if (!assemble(file_name, program.code)) {
+            std::cerr << "failed to open file \"" << file_name << "\"\n";
+            return 1;
+        }
+        program.instructions = count_instructions(program.code);
+        programs.push_back(std::move(program));
+    }
+
+#if !defined(__OPTIMIZE__) || !defined(NDEBUG)
+    std::cerr << "pebble_bench: not an optimised build without assertions, configure with "
+                 "-DCMAKE_BUILD_TYPE=Release for numbers worth comparing\n";
+#endif
+
+    auto dispatch = std::find_if(programs.begin(), programs.end(), [](auto& p) { return p.name == "dispatch"; });
+
+    std::cout << std::left << std::setw(10) << "engine" << std::setw(12) << "program"
+              << std::right << std::setw(14) << "instructions" << std::setw(12) << "ms"
+              << std::setw(12) << "Minstr/s" << std::setw(12) << "ns/instr" << std::setw(12) << "dispatch"
+              << "\n" << std::fixed;
+
+    for (auto& engine : selected_engines) {
+        double dispatch_ns = 0;
+        if (dispatch != programs.end()) {
+            dispatch_ns = fastest_run(engine.engine, dispatch->code, repetitions) * 1e9 / dispatch->instructions;
+        }
+
+        for (auto& program : programs) {
+            auto seconds = fastest_run(engine.engine, program.code, repetitions);
+            auto ns = seconds * 1e9 / program.instructions;
+
+            std::cout << std::left << std::setw(10) << engine.name << std::setw(12) << program.name
+                      << std::right << std::setw(14) << program.instructions
+                      << std::setw(12) << std::setprecision(2) << seconds * 1e3
+                      << std::setw(12) << std::setprecision(1) << program.instructions / seconds / 1e6
+                      << std::setw(12) << std::setprecision(2) << ns;
+            if (dispatch_ns > 0) {
+                std::cout << std::setw(11) << std::setprecision(0) << std::min(dispatch_ns / ns, 1.0) * 100 << "%";
+            }
+            std::cout << "\n";
+        }
+
+        if (dispatch_ns > 0) {
+            std::cout << std::left << std::setw(10) << engine.name << "dispatch overhead "
+                      << std::setprecision(2) << dispatch_ns << " ns/instr\n";
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../assembler/assembler.h"
+#include "../vm/aot.h"
+#include "../vm/vm.h"
+
+// runs programs on each engine and fails if any two end in a different state,
+// comparing how the run ended, the registers and every accessible word of memory
+//
+// usage: pebble_compare <program.asm>...
+//
+// ctest runs it on the programs in tests/, each of which once made an engine
+// go its own way
+
+struct EngineName {
+    pebble::Engine engine;
+    std::string name;
+};
+
+const std::vector<EngineName> engines = {
+        {pebble::Engine::Switch,   "switch"},
+        {pebble::Engine::Threaded, "threaded"},
+        {pebble::Engine::Jit,      "jit"},
+};
+
+const char* status_name(pebble::RunStatus status) {
+    switch (status) {
+        case pebble::RunStatus::Halted:
+            return "halted";
+        case pebble::RunStatus::OutOfFuel:
+            return "out of fuel";
+        case pebble::RunStatus::Faulted:
+            return "faulted";
+    }
+    return "unknown";
+}
+
+struct Outcome {
+    pebble::RunStatus status;
+    pebble::AotState state;
+};
+
+void run(pebble::Engine engine, const std::vector<unsigned int>& code, const pebble::DataSection& data, Outcome& outcome) {
+    pebble::VM vm(engine);
+    vm.load(code, data);
+    outcome.status = vm.run();
+    vm.save(outcome.state);
+}
+
+// reports the first difference between the outcomes, if there is one
+bool same(const Outcome& expected, const Outcome& actual, const std::string& program, const std::string& engine) {
+    auto& e = expected.state;
+    auto& a = actual.state;
+
+    if (expected.status != actual.status) {
+        std::cerr << program << ": " << engine << " " << status_name(actual.status) << ", switch "
+                  << status_name(expected.status) << "\n";
+        return false;
+    }
+
+    const unsigned int expected_registers[] = {e.a, e.b, e.ip, e.sp, e.fp};
+    const unsigned int actual_registers[] = {a.a, a.b, a.ip, a.sp, a.fp};
+    const char* register_names[] = {"a", "b", "ip", "sp", "fp"};
+    for (unsigned int i = 0; i < pebble::NumRegisters; i++) {
+        if (expected_registers[i] != actual_registers[i]) {
+            std::cerr << program << ": " << engine << " ends with " << register_names[i] << "="
+                      << actual_registers[i] << ", switch with " << expected_registers[i] << "\n";
+            return false;
+        }
+    }
+
+    for (unsigned long long address = 0; address < e.memory.size(); address++) {
+        if (e.memory.accessible(address) && e.memory[address] != a.memory[address]) {
+            std::cerr << program << ": " << engine << " ends with " << a.memory[address] << " at "
+                      << address << ", switch with " << e.memory[address] << "\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: pebble_compare <program.asm>...\n";
+        return 1;
+    }
+
+    bool all_same = true;
+
+    for (int i = 1; i < argc; i++) {
+        std::string file_name = argv[i];
+        std::ifstream file(file_name);
+        if (file.fail()) {
+            std::cerr << "failed to open file \"" << file_name << "\"\n";
+            return 1;
+        }
+
+        pebble::Assembler assembler;
+        auto code = assembler.run(file);
+
+        Outcome expected;
+        run(engines[0].engine, code, assembler.data(), expected);
+
+        for (unsigned int engine = 1; engine < engines.size(); engine++) {
+            Outcome actual;
+            run(engines[engine].engine, code, assembler.data(), actual);
+            all_same = same(expected, actual, file_name, engines[engine].name) && all_same;
+        }
+    }
+
+    return all_same ? 0 : 1;
+}
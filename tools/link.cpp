@@ -0,0 +1,69 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../assembler/assembler.h"
+#include "../assembler/linker.h"
+
+// links objects written by pebble -c into an image, leaving out the code
+// that can't be reached from where the program starts, see assembler/linker.h
+//
+// inputs ending in .asm are assembled as objects first
+//
+// usage: pebble_link -o output <object>...
+
+using namespace pebble;
+
+int main(int argc, char* argv[]) {
+    std::string output_file_name;
+    std::vector<std::string> input_file_names;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc) {
+            output_file_name = argv[++i];
+        } else {
+            input_file_names.push_back(arg);
+        }
+    }
+
+    if (output_file_name.empty() || input_file_names.empty()) {
+        std::cerr << "usage: pebble_link -o output <object>...\n";
+        return 1;
+    }
+
+    Linker linker;
+
+    for (auto& file_name : input_file_names) {
+        std::ifstream input_file(file_name, std::ios::binary);
+        if (input_file.fail()) {
+            std::cerr << "failed to open file \"" << file_name << "\"\n";
+            return 1;
+        }
+
+        Object object;
+        if (file_name.ends_with(".asm")) {
+            Assembler assembler;
+            object = assembler.run_object(input_file);
+        } else if (!object.read(input_file)) {
+            std::cerr << "in \"" << file_name << "\"\n";
+            return 1;
+        }
+
+        linker.add(std::move(object));
+    }
+
+    if (!linker.link()) {
+        return 1;
+    }
+
+    std::ofstream output_file(output_file_name, std::ios::binary);
+    linker.write_image(output_file);
+    if (!output_file.good()) {
+        std::cerr << "failed to write file \"" << output_file_name << "\"\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../vm/decoder.h"
+
+// generates the SUPERINSTRUCTIONS list for vm/decoder.h from handler pair
+// counts written by VM::run_profiled (pebble --ngrams <file> <program>)
+//
+// superinstructions are pairs only: the decoder fuses a record with the one
+// after it, and the threaded engine runs the second half through its own
+// handler. the profile's triples can't be fused, so the most frequent ones are
+// listed as comments in the output to show what longer superinstructions
+// would gain
+//
+// usage: pebble_superinstructions [-n count] [-o output] <profile>...
+
+#define HANDLER_NAME(NAME) #NAME,
+
+const std::set<std::string> sequential_handlers = {
+        SEQUENTIAL_HANDLERS(HANDLER_NAME)
+};
+
+const std::set<std::string> control_handlers = {
+        CONTROL_HANDLERS(HANDLER_NAME)
+};
+
+int main(int argc, char* argv[]) {
+    unsigned int count = 8;
+    std::string output_file_name;
+    std::vector<std::string> profile_file_names;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc) {
+            count = std::stoul(argv[++i]);
+        } else if (arg == "-o" && i + 1 < argc) {
+            output_file_name = argv[++i];
+        } else {
+            profile_file_names.push_back(arg);
+        }
+    }
+
+    if (profile_file_names.empty()) {
+        std::cerr << "usage: pebble_superinstructions [-n count] [-o output] <profile>...\n";
+        return 1;
+    }
+
+    std::map<std::pair<std::string, std::string>, unsigned long long> counts;
+    std::map<std::vector<std::string>, unsigned long long> triple_counts;
+
+    for (auto& file_name : profile_file_names) {
+        std::ifstream profile(file_name);
+        if (profile.fail()) {
+            std::cerr << "failed to open file \"" << file_name << "\"\n";
+            return 1;
+        }
+
+        // each line is the handlers that ran back to back followed by a count
+        std::string line;
+        while (std::getline(profile, line)) {
+            std::istringstream fields(line);
+            std::vector<std::string> handlers;
+            std::string field;
+            while (fields >> field) {
+                handlers.push_back(field);
+            }
+            if (handlers.size() < 3) {
+                continue;
+            }
+
+            unsigned long long n = std::stoull(handlers.back());
+            handlers.pop_back();
+
+            // only a handler that always falls through can start a superinstruction,
+            // and only the last handler of a sequence may jump
+            bool fusable = std::all_of(handlers.begin(), handlers.end() - 1, [](auto& handler) {
+                return sequential_handlers.contains(handler);
+            }) && (sequential_handlers.contains(handlers.back()) || control_handlers.contains(handlers.back()));
+            if (!fusable) {
+                continue;
+            }
+
+            if (handlers.size() == 2) {
+                counts[{handlers[0], handlers[1]}] += n;
+            } else if (handlers.size() == 3) {
+                triple_counts[handlers] += n;
+            }
+        }
+    }
+
+    std::vector<std::pair<unsigned long long, std::pair<std::string, std::string>>> ranked;
+    for (auto& [pair, n] : counts) {
+        ranked.emplace_back(n, pair);
+    }
+
+    // most frequent first, ties broken by name so the output is stable
+    std::sort(ranked.begin(), ranked.end(), [](auto& l, auto& r) {
+        return l.first != r.first ? l.first > r.first : l.second < r.second;
+    });
+
+    if (ranked.size() > count) {
+        ranked.resize(count);
+    }
+
+    std::vector<std::pair<unsigned long long, std::vector<std::string>>> ranked_triples;
+    for (auto& [triple, n] : triple_counts) {
+        ranked_triples.emplace_back(n, triple);
+    }
+
+    std::sort(ranked_triples.begin(), ranked_triples.end(), [](auto& l, auto& r) {
+        return l.first != r.first ? l.first > r.first : l.second < r.second;
+    });
+
+    if (ranked_triples.size() > count) {
+        ranked_triples.resize(count);
+    }
+
+    std::ofstream output_file;
+    if (!output_file_name.empty()) {
+        output_file.open(output_file_name);
+        if (output_file.fail()) {
+            std::cerr << "failed to open file \"" << output_file_name << "\"\n";
+            return 1;
+        }
+    }
+
+    std::ostream& out = output_file_name.empty() ? std::cout : output_file;
+
+    out << "#pragma once\n\n";
+    out << "// generated by pebble_superinstructions, do not edit\n";
+    out << "//\n";
+    out << "// each entry fuses a sequential handler with the handler that follows it\n";
+    if (!ranked_triples.empty()) {
+        out << "//\n";
+        out << "// most frequent triples, which are not fused:\n";
+        for (auto& [n, triple] : ranked_triples) {
+            out << "//   " << triple[0] << " " << triple[1] << " " << triple[2] << " " << n << "\n";
+        }
+    }
+    out << "#define SUPERINSTRUCTIONS(X)";
+    for (auto& [n, pair] : ranked) {
+        out << " \\\n    X(" << pair.first << ", " << pair.second << ")";
+    }
+    out << "\n";
+
+    return 0;
+}
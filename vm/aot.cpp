@@ -0,0 +1,50 @@
+#include <cassert>
+
+#include "aot.h"
+
+namespace pebble {
+
+void aot_load(AotState& state, const AotProgram& program) {
+    assert(program.code_size <= state.memory.size());
+    assert(program.data_size == 0 ||
+           (program.data_address > program.code_size &&
+            program.data_address + static_cast<unsigned long long>(program.data_size) <= state.memory.size()));
+
+    for (unsigned int i = 0; i < program.code_size; i++) {
+        state.memory[i] = program.code[i];
+    }
+
+    for (unsigned int i = 0; i < program.data_size; i++) {
+        state.memory[program.data_address + i] = program.data[i];
+    }
+
+    state.code_size = program.code_size;
+}
+
+AotNext aot_execute(AotState& state) {
+    if (!state.interpreter) {
+        // the switch engine runs exactly one instruction on a budget of one word
+        state.interpreter = std::make_unique<VM>(Engine::Switch, MemoryConfig{.size = 1});
+    }
+
+    auto& vm = *state.interpreter;
+    vm.load(state);
+    auto verified = vm.verified().verified;
+    auto status = vm.run(1);
+    vm.save(state);
+
+    if (status == RunStatus::Faulted) {
+        return AotNext::Stop;
+    }
+    return verified && !vm.verified().verified ? AotNext::Interpret : AotNext::Dispatch;
+}
+
+void aot_interpret(AotState& state) {
+    // the VM runs on the state's memory, its own is only held while it does
+    VM vm(default_engine, MemoryConfig{.size = 1});
+    vm.load(state);
+    vm.run();
+    vm.save(state);
+}
+
+}
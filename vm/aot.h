@@ -0,0 +1,62 @@
+#pragma once
+
+#include "vm.h"
+
+namespace pebble {
+
+// the registers and memory of a VM, which programs translated to C++ by
+// pebble_aot run on directly
+struct AotState {
+    unsigned int a = 0;
+    unsigned int b = 0;
+    unsigned int ip = 0;
+    unsigned int sp;
+    unsigned int fp;
+    unsigned int code_size = 0;
+    Memory memory;
+    // handed to the VM the program falls back to, which runs every native call
+    std::vector<NativeFunction> natives;
+    // the VM aot_execute runs single instructions on, kept between them
+    std::unique_ptr<VM> interpreter;
+
+    // the stack starts at the top of memory the same as in a VM
+    explicit AotState(const MemoryConfig& memory = {})
+            : sp(memory.size - 1), fp(memory.size - 1), memory(memory) {}
+};
+
+// a program translated by pebble_aot, declared where it's used with
+// extern const pebble::AotProgram <name>;
+struct AotProgram {
+    const unsigned int* code;
+    unsigned int code_size;
+    // the program's data section, see Assembler::data
+    const unsigned int* data;
+    unsigned int data_size;
+    unsigned int data_address;
+    // runs from state.ip until the program halts
+    void (*run)(AotState& state);
+};
+
+// loads the program and its data into memory the same way VM::load does
+void aot_load(AotState& state, const AotProgram& program);
+
+// runs the state on a VM until it halts, translated programs hand over to it
+// for anything they can't run themselves
+void aot_interpret(AotState& state);
+
+// what a translated program does after aot_execute
+enum class AotNext {
+    // carries on from state.ip
+    Dispatch,
+    // the instruction wrote into the code, so the VM runs the rest, see aot_interpret
+    Interpret,
+    // the instruction faulted
+    Stop
+};
+
+// runs the one instruction at state.ip on a VM, for the ones translated
+// programs don't run themselves but can carry on after: native calls, vector
+// and block instructions and anything else the decoder leaves to VM::execute
+AotNext aot_execute(AotState& state);
+
+}
@@ -0,0 +1,188 @@
+#include "decoder.h"
+#include "vm.h"
+
+namespace pebble {
+
+namespace {
+
+// ip is left to VM::execute so the fast handlers never have to sync it
+bool is_general_register(unsigned int index) {
+    return index < NumRegisters && index != RegisterIP;
+}
+
+DecodedInstruction generic(unsigned int width) {
+    return DecodedInstruction{.handler = Handler::Generic, .width = (unsigned char) (width ? width : 1)};
+}
+
+DecodedInstruction with_register(Handler handler, unsigned int width, unsigned int reg, unsigned int operand) {
+    return DecodedInstruction{
+            .handler = handler,
+            .width = (unsigned char) width,
+            .reg = (unsigned char) reg,
+            .operand = operand
+    };
+}
+
+}
+
+unsigned int instruction_width(unsigned int word) {
+    if (Instruction::opcode(word) >= Opcode::NumOpcodes) {
+        return 0;
+    }
+    return Instruction::width(word);
+}
+
+#define ARITHMETIC_LOGIC_DECODE_CASE(NAME, OPERATOR) \
+case Opcode::NAME: \
+    if (!is_general_register(destination)) { \
+        return generic(width); \
+    } \
+    if (has_immediate) { \
+        return with_register(Handler::NAME##Immediate, width, destination, immediate); \
+    } \
+    if (!is_general_register(source)) { \
+        return generic(width); \
+    } \
+    return with_register(Handler::NAME##Register, width, destination, source);
+
+DecodedInstruction decode(const unsigned int* memory, unsigned int address, unsigned int code_size) {
+    auto word = memory[address];
+    auto width = instruction_width(word);
+
+    // unknown opcodes and instructions running off the end of the program
+    if (width == 0 || code_size - address < width) {
+        return generic(width);
+    }
+
+    auto destination = Instruction::destination(word);
+    auto source = Instruction::source(word);
+    auto has_immediate = Instruction::has_immediate(word);
+    auto immediate = has_immediate ? memory[address + 1] : 0;
+    auto frame_pointer_offset = Instruction::addressing_mode(word) == Opcode::AddressingModeFramePointerOffset;
+
+    switch (Instruction::opcode(word)) {
+        case Opcode::Halt:
+            return with_register(Handler::Halt, width, 0, 0);
+
+        case Opcode::Load:
+            if (!is_general_register(destination) || !has_immediate) {
+                return generic(width);
+            }
+            return with_register(frame_pointer_offset ? Handler::LoadFramePointerOffset : Handler::LoadAddress,
+                                 width, destination, immediate);
+
+        case Opcode::Store:
+            if (!is_general_register(source) || !has_immediate) {
+                return generic(width);
+            }
+            return with_register(frame_pointer_offset ? Handler::StoreFramePointerOffset : Handler::StoreAddress,
+                                 width, source, immediate);
+
+        case Opcode::Move:
+            if (!is_general_register(destination)) {
+                return generic(width);
+            }
+            if (has_immediate) {
+                return with_register(Handler::MoveImmediate, width, destination, immediate);
+            }
+            if (!is_general_register(source)) {
+                return generic(width);
+            }
+            return with_register(Handler::MoveRegister, width, destination, source);
+
+        ARITHMETIC_LOGIC_OPERATIONS(ARITHMETIC_LOGIC_DECODE_CASE)
+
+        case Opcode::Not:
+            if (!is_general_register(destination)) {
+                return generic(width);
+            }
+            if (has_immediate) {
+                return with_register(Handler::NotImmediate, width, destination, immediate);
+            }
+            if (source >= NumRegisters) {
+                return generic(width);
+            }
+            return with_register(Handler::NotRegister, width, destination, source);
+
+        case Opcode::Jump:
+            return has_immediate ? with_register(Handler::Jump, width, 0, immediate) : generic(width);
+
+        case Opcode::JumpIfZero:
+            return has_immediate ? with_register(Handler::JumpIfZero, width, 0, immediate) : generic(width);
+
+        case Opcode::JumpIfNonZero:
+            return has_immediate ? with_register(Handler::JumpIfNonZero, width, 0, immediate) : generic(width);
+
+        case Opcode::Call:
+            return has_immediate ? with_register(Handler::Call, width, 0, immediate) : generic(width);
+
+        case Opcode::Push:
+            if (has_immediate) {
+                return with_register(Handler::PushImmediate, width, 0, immediate);
+            }
+            if (!is_general_register(source)) {
+                return generic(width);
+            }
+            return with_register(Handler::PushRegister, width, source, 0);
+
+        case Opcode::Pop:
+            if (!is_general_register(destination)) {
+                return generic(width);
+            }
+            return with_register(Handler::Pop, width, destination, 0);
+
+        case Opcode::Return:
+            return with_register(Handler::Return, width, 0, 0);
+
+        case Opcode::Native:
+            return has_immediate ? with_register(Handler::Native, width, 0, immediate) : generic(width);
+
+        default:
+            return generic(width);
+    }
+}
+
+#define SUPERINSTRUCTION_FUSE_CASE(FIRST, SECOND) \
+if (first == Handler::FIRST && second == Handler::SECOND) { \
+    return Handler::FIRST##_##SECOND; \
+}
+
+Handler fuse(Handler first, Handler second) {
+    SUPERINSTRUCTIONS(SUPERINSTRUCTION_FUSE_CASE)
+    return first;
+}
+
+#define SUPERINSTRUCTION_UNFUSED_CASE(FIRST, SECOND) \
+case Handler::FIRST##_##SECOND: \
+    return Handler::FIRST;
+
+Handler unfused(Handler handler) {
+    switch (handler) {
+        SUPERINSTRUCTIONS(SUPERINSTRUCTION_UNFUSED_CASE)
+        default:
+            return handler;
+    }
+}
+
+#define HANDLER_NAME_CASE(NAME) \
+case Handler::NAME: \
+    return #NAME;
+
+#define SUPERINSTRUCTION_NAME_CASE(FIRST, SECOND) \
+case Handler::FIRST##_##SECOND: \
+    return #FIRST "_" #SECOND;
+
+const char* handler_name(Handler handler) {
+    switch (handler) {
+        SEQUENTIAL_HANDLERS(HANDLER_NAME_CASE)
+        CONTROL_HANDLERS(HANDLER_NAME_CASE)
+        SUPERINSTRUCTIONS(SUPERINSTRUCTION_NAME_CASE)
+        SPECIAL_HANDLERS(HANDLER_NAME_CASE)
+        case Handler::NumHandlers:
+            break;
+    }
+
+    return "unknown";
+}
+
+}
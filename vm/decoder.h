@@ -0,0 +1,158 @@
+#pragma once
+
+#ifdef PEBBLE_SUPERINSTRUCTIONS_HEADER
+#include PEBBLE_SUPERINSTRUCTIONS_HEADER
+#else
+#include "superinstructions.h"
+#endif
+
+namespace pebble {
+
+#define ARITHMETIC_LOGIC_OPERATIONS(X) \
+    X(Add, +) \
+    X(Subtract, -) \
+    X(Multiply, *) \
+    X(Divide, /) \
+    X(Modulo, %) \
+    X(And, &) \
+    X(Or, |) \
+    X(ShiftLeft, <<) \
+    X(ShiftRight, >>) \
+    X(GreaterThan, >) \
+    X(GreaterThanOrEqualTo, >=) \
+    X(LessThan, <) \
+    X(LessThanOrEqualTo, <=) \
+    X(EqualTo, ==) \
+    X(NotEqualTo, !=)
+
+// one type per arithmetic / logic operation, for handlers specialised on it
+namespace Operation {
+
+#define OPERATION_TYPE(NAME, OPERATOR) \
+struct NAME { \
+    static unsigned int apply(unsigned int l, unsigned int r) { \
+        return l OPERATOR r; \
+    } \
+};
+
+ARITHMETIC_LOGIC_OPERATIONS(OPERATION_TYPE)
+
+#undef OPERATION_TYPE
+
+}
+
+// the decoder resolves the operand kind of each instruction up front, so there
+// is one handler per opcode and operand kind
+
+// handlers that always continue with the instruction after them
+#define SEQUENTIAL_HANDLERS(X) \
+    X(LoadAddress) \
+    X(LoadFramePointerOffset) \
+    X(StoreAddress) \
+    X(StoreFramePointerOffset) \
+    X(MoveRegister) \
+    X(MoveImmediate) \
+    X(AddRegister) \
+    X(AddImmediate) \
+    X(SubtractRegister) \
+    X(SubtractImmediate) \
+    X(MultiplyRegister) \
+    X(MultiplyImmediate) \
+    X(DivideRegister) \
+    X(DivideImmediate) \
+    X(ModuloRegister) \
+    X(ModuloImmediate) \
+    X(AndRegister) \
+    X(AndImmediate) \
+    X(OrRegister) \
+    X(OrImmediate) \
+    X(ShiftLeftRegister) \
+    X(ShiftLeftImmediate) \
+    X(ShiftRightRegister) \
+    X(ShiftRightImmediate) \
+    X(GreaterThanRegister) \
+    X(GreaterThanImmediate) \
+    X(GreaterThanOrEqualToRegister) \
+    X(GreaterThanOrEqualToImmediate) \
+    X(LessThanRegister) \
+    X(LessThanImmediate) \
+    X(LessThanOrEqualToRegister) \
+    X(LessThanOrEqualToImmediate) \
+    X(EqualToRegister) \
+    X(EqualToImmediate) \
+    X(NotEqualToRegister) \
+    X(NotEqualToImmediate) \
+    X(NotRegister) \
+    X(NotImmediate) \
+    X(PushRegister) \
+    X(PushImmediate) \
+    X(Pop) \
+    X(Native)
+
+// handlers that may continue anywhere
+#define CONTROL_HANDLERS(X) \
+    X(Halt) \
+    X(Jump) \
+    X(JumpIfZero) \
+    X(JumpIfNonZero) \
+    X(Call) \
+    X(Return)
+
+// handlers that can't be part of a superinstruction:
+// - Generic runs anything the fast handlers don't cover (ip as an operand, bad
+//   register indices, unknown opcodes) through VM::execute
+// - Undecoded marks a record whose words were written since it was decoded
+// - OutOfCode sits one past the end of the code region
+#define SPECIAL_HANDLERS(X) \
+    X(Generic) \
+    X(Undecoded) \
+    X(OutOfCode)
+
+#define HANDLER_ENUM_ENTRY(NAME) NAME,
+#define SUPERINSTRUCTION_ENUM_ENTRY(FIRST, SECOND) FIRST##_##SECOND,
+
+enum class Handler : unsigned short {
+    SEQUENTIAL_HANDLERS(HANDLER_ENUM_ENTRY)
+    CONTROL_HANDLERS(HANDLER_ENUM_ENTRY)
+    // a sequential handler fused with the handler after it, see superinstructions.h
+    SUPERINSTRUCTIONS(SUPERINSTRUCTION_ENUM_ENTRY)
+    SPECIAL_HANDLERS(HANDLER_ENUM_ENTRY)
+    NumHandlers
+};
+
+#undef HANDLER_ENUM_ENTRY
+#undef SUPERINSTRUCTION_ENUM_ENTRY
+
+struct DecodedInstruction {
+    Handler handler;
+    unsigned char width;
+    // register index used by the instruction, if any
+    unsigned char reg;
+    // immediate, register index, address or frame pointer offset depending on the handler
+    unsigned int operand;
+};
+
+static_assert(sizeof(DecodedInstruction) == 8);
+
+// widest instruction in words
+const unsigned int max_instruction_width = 2;
+
+// a superinstruction record covers its own instruction and the next one, so a
+// write can change the meaning of a record starting this many words before it
+const unsigned int max_record_span = 2 * max_instruction_width;
+
+// width in words of the instruction starting with word, 0 if its opcode is unknown
+unsigned int instruction_width(unsigned int word);
+
+// decodes the instruction at address, treating everything from code_size on as outside the program
+DecodedInstruction decode(const unsigned int* memory, unsigned int address, unsigned int code_size);
+
+// the superinstruction for first followed by second, or first if there is none
+Handler fuse(Handler first, Handler second);
+
+// the handler a record had before fusion
+Handler unfused(Handler handler);
+
+const char* handler_name(Handler handler);
+
+}
@@ -0,0 +1,166 @@
+#include "executor.h"
+
+namespace pebble {
+
+namespace {
+
+// the executor and worker the current thread belongs to, if any
+thread_local const Executor* current_executor = nullptr;
+thread_local unsigned int current_worker = 0;
+
+}
+
+bool Task::start() {
+    auto expected = TaskStatus::Queued;
+    return current_status.compare_exchange_strong(expected, TaskStatus::Running);
+}
+
+void Task::finish(TaskStatus status) {
+    {
+        std::lock_guard lock(mutex);
+        current_status = status;
+    }
+    finished.notify_all();
+}
+
+Executor::Executor(unsigned int worker_count, unsigned long long time_slice) : time_slice(time_slice) {
+    if (worker_count == 0) {
+        worker_count = 1;
+    }
+
+    for (unsigned int i = 0; i < worker_count; i++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+
+    // every worker has to exist before any of them can steal
+    for (unsigned int i = 0; i < worker_count; i++) {
+        workers[i]->thread = std::thread(&Executor::work, this, i);
+    }
+}
+
+Executor::~Executor() {
+    {
+        std::lock_guard lock(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto& worker : workers) {
+        worker->thread.join();
+    }
+}
+
+std::shared_ptr<Task> Executor::submit(std::unique_ptr<VM> vm) {
+    auto task = std::make_shared<Task>(std::move(vm));
+
+    auto worker = current_executor == this ? current_worker : next_worker++ % workers.size();
+    push(worker, task);
+
+    return task;
+}
+
+TaskStatus Executor::await(Task& task) {
+    std::unique_lock lock(task.mutex);
+    task.finished.wait(lock, [&] {
+        auto status = task.status();
+        return status == TaskStatus::Halted || status == TaskStatus::Cancelled || status == TaskStatus::Faulted;
+    });
+    return task.status();
+}
+
+bool Executor::cancel(Task& task) {
+    // the worker checks this before and after every slice
+    task.cancel_requested = true;
+
+    auto expected = TaskStatus::Queued;
+    if (task.current_status.compare_exchange_strong(expected, TaskStatus::Cancelled)) {
+        // the queue entry stays behind and is dropped when a worker reaches it
+        task.finish(TaskStatus::Cancelled);
+        return true;
+    }
+
+    return expected == TaskStatus::Running;
+}
+
+void Executor::push(unsigned int worker, std::shared_ptr<Task> task) {
+    {
+        std::lock_guard lock(workers[worker]->mutex);
+        workers[worker]->queue.push_back(std::move(task));
+    }
+
+    queued++;
+
+    // taking the lock orders the count above before a sleeping worker checks it
+    {
+        std::lock_guard lock(sleep_mutex);
+    }
+    wake.notify_one();
+}
+
+// in turn from the worker's own queue, the last in line from the others
+std::shared_ptr<Task> Executor::take(unsigned int worker) {
+    {
+        auto& own = *workers[worker];
+        std::lock_guard lock(own.mutex);
+        if (!own.queue.empty()) {
+            auto task = std::move(own.queue.front());
+            own.queue.pop_front();
+            return task;
+        }
+    }
+
+    for (unsigned int i = 1; i < workers.size(); i++) {
+        auto& victim = *workers[(worker + i) % workers.size()];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.queue.empty()) {
+            auto task = std::move(victim.queue.back());
+            victim.queue.pop_back();
+            return task;
+        }
+    }
+
+    return nullptr;
+}
+
+void Executor::work(unsigned int worker) {
+    current_executor = this;
+    current_worker = worker;
+
+    while (true) {
+        auto task = take(worker);
+
+        if (!task) {
+            std::unique_lock lock(sleep_mutex);
+            wake.wait(lock, [&] { return stopping || queued > 0; });
+            if (stopping && queued == 0) {
+                return;
+            }
+            continue;
+        }
+
+        queued--;
+
+        if (!task->start()) {
+            continue;
+        }
+
+        if (task->cancel_requested || stopping) {
+            task->finish(TaskStatus::Cancelled);
+            continue;
+        }
+
+        auto status = task->machine->run(time_slice);
+        if (status == RunStatus::Halted) {
+            task->finish(TaskStatus::Halted);
+        } else if (status == RunStatus::Faulted) {
+            task->finish(TaskStatus::Faulted);
+        } else if (task->cancel_requested || stopping) {
+            task->finish(TaskStatus::Cancelled);
+        } else {
+            task->current_status = TaskStatus::Queued;
+            push(worker, std::move(task));
+        }
+    }
+}
+
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "vm.h"
+
+namespace pebble {
+
+enum class TaskStatus {
+    Queued,
+    Running,
+    Halted,
+    Cancelled,
+    // the program faulted, see VM::run
+    Faulted
+};
+
+// a VM submitted to an Executor
+class Task {
+    std::unique_ptr<VM> machine;
+    std::atomic<TaskStatus> current_status{TaskStatus::Queued};
+    // checked between time slices, see Executor::cancel
+    std::atomic<bool> cancel_requested{false};
+
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    // moves the task from Queued to Running, false if it had already left Queued
+    bool start();
+    void finish(TaskStatus status);
+
+    friend class Executor;
+
+public:
+    explicit Task(std::unique_ptr<VM> vm) : machine(std::move(vm)) {}
+
+    TaskStatus status() const {
+        return current_status.load();
+    }
+
+    // only safe to use once the task has halted or was cancelled
+    VM& vm() {
+        return *machine;
+    }
+};
+
+// the fuel a VM runs for before the next one in its worker's queue gets a
+// turn, in words the same as VM::run
+const unsigned long long default_time_slice = 100000;
+
+// runs VMs on a fixed pool of worker threads
+//
+// each worker has its own queue which it runs in turn, a VM that uses up its
+// time slice goes to the back of the same queue so it keeps to one core. a VM
+// submitted from a worker is queued on that worker. idle workers steal from
+// the back of the other queues
+class Executor {
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::shared_ptr<Task>> queue;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<unsigned int> next_worker{0};
+    unsigned long long time_slice;
+
+    // tasks in any queue, idle workers sleep while there are none
+    std::atomic<size_t> queued{0};
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    // set by the destructor, everything still queued or running is cancelled
+    std::atomic<bool> stopping{false};
+
+    void push(unsigned int worker, std::shared_ptr<Task> task);
+    std::shared_ptr<Task> take(unsigned int worker);
+    void work(unsigned int worker);
+
+public:
+    explicit Executor(unsigned int worker_count = std::thread::hardware_concurrency(),
+                      unsigned long long time_slice = default_time_slice);
+    // cancels every task that hasn't halted, running ones at the end of their time slice
+    ~Executor();
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    unsigned int worker_count() const {
+        return workers.size();
+    }
+
+    std::shared_ptr<Task> submit(std::unique_ptr<VM> vm);
+
+    // blocks until the task has halted, faulted or was cancelled
+    TaskStatus await(Task& task);
+
+    // a queued task is cancelled straight away, a running one at the end of its
+    // time slice. false if the task had already finished
+    bool cancel(Task& task);
+};
+
+}
@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include "image.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PEBBLE_MMAP_IMAGE
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace pebble {
+
+namespace {
+
+unsigned long long align(unsigned long long offset) {
+    return (offset + image_alignment - 1) / image_alignment * image_alignment;
+}
+
+void write_words(std::ostream& out, const std::vector<unsigned int>& words) {
+    out.write(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(unsigned int));
+}
+
+void pad(std::ostream& out, unsigned long long from, unsigned long long to) {
+    std::fill_n(std::ostreambuf_iterator<char>(out), to - from, 0);
+}
+
+}
+
+bool DataSection::add(unsigned int address, const std::vector<unsigned int>& words) {
+    auto end = address + static_cast<unsigned long long>(words.size());
+    if (end > 1ull << 32) {
+        return false;
+    }
+    for (auto [first, last] : added) {
+        if (address < last && first < end) {
+            return false;
+        }
+    }
+    added.emplace_back(address, end);
+
+    if (contents.empty()) {
+        start = address;
+        contents = words;
+        return true;
+    }
+
+    auto first = std::min(start, address);
+    std::vector<unsigned int> merged(std::max<unsigned long long>(start + contents.size(), end) - first);
+    std::copy(contents.begin(), contents.end(), merged.begin() + (start - first));
+    std::copy(words.begin(), words.end(), merged.begin() + (address - first));
+    start = first;
+    contents = std::move(merged);
+    return true;
+}
+
+bool is_image(const std::string& file_name) {
+    std::ifstream file(file_name, std::ios::binary);
+    unsigned int magic = 0;
+    file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    return file && magic == image_magic;
+}
+
+void write_image(std::ostream& out, const std::vector<unsigned int>& code, const std::vector<unsigned int>& data,
+                 unsigned int data_address, const std::unordered_map<std::string, unsigned int>& symbols) {
+    // sorted so the same program always gives the same file
+    std::vector<std::pair<unsigned int, std::string>> sorted_symbols;
+    for (auto& [name, address] : symbols) {
+        sorted_symbols.emplace_back(address, name);
+    }
+    std::sort(sorted_symbols.begin(), sorted_symbols.end());
+
+    std::vector<ImageSymbol> symbol_table;
+    std::string names;
+    for (auto& [address, name] : sorted_symbols) {
+        symbol_table.push_back(ImageSymbol{
+                .address = address,
+                .name_offset = static_cast<unsigned int>(names.size()),
+                .name_length = static_cast<unsigned int>(name.size())
+        });
+        names += name;
+    }
+
+    ImageHeader header{
+            .magic = image_magic,
+            .version = image_version,
+            .code_size = static_cast<unsigned int>(code.size()),
+            .data_size = static_cast<unsigned int>(data.size()),
+            .data_address = data_address,
+            .symbol_count = static_cast<unsigned int>(symbol_table.size()),
+    };
+    header.code_offset = align(sizeof(ImageHeader));
+    header.data_offset = align(header.code_offset + code.size() * sizeof(unsigned int));
+    header.symbols_offset = align(header.data_offset + data.size() * sizeof(unsigned int));
+    header.names_size = names.size();
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    pad(out, sizeof(header), header.code_offset);
+    write_words(out, code);
+    pad(out, header.code_offset + code.size() * sizeof(unsigned int), header.data_offset);
+    write_words(out, data);
+    pad(out, header.data_offset + data.size() * sizeof(unsigned int), header.symbols_offset);
+    out.write(reinterpret_cast<const char*>(symbol_table.data()), symbol_table.size() * sizeof(ImageSymbol));
+    out.write(names.data(), names.size());
+}
+
+Image::~Image() {
+    close();
+}
+
+void Image::close() {
+#ifdef PEBBLE_MMAP_IMAGE
+    if (bytes && buffer.empty()) {
+        munmap(const_cast<char*>(bytes), size);
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+#endif
+
+    fd = -1;
+    bytes = nullptr;
+    size = 0;
+    buffer.clear();
+}
+
+bool Image::open(const std::string& file_name) {
+    close();
+
+#ifdef PEBBLE_MMAP_IMAGE
+    fd = ::open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat status{};
+    if (fd < 0 || fstat(fd, &status) != 0) {
+        std::cerr << "vm: failed to open image \"" << file_name << "\"\n";
+        close();
+        return false;
+    }
+
+    size = status.st_size;
+    if (size > 0) {
+        auto mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            std::cerr << "vm: failed to map image \"" << file_name << "\"\n";
+            close();
+            return false;
+        }
+        bytes = static_cast<const char*>(mapping);
+    }
+#else
+    std::ifstream file(file_name, std::ios::binary);
+    if (file.fail()) {
+        std::cerr << "vm: failed to open image \"" << file_name << "\"\n";
+        return false;
+    }
+    buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    bytes = buffer.data();
+    size = buffer.size();
+#endif
+
+    auto fits = [&](unsigned long long offset, unsigned long long length) {
+        return offset <= size && length <= size - offset;
+    };
+
+    if (!fits(0, sizeof(ImageHeader)) || header().magic != image_magic) {
+        std::cerr << "vm: \"" << file_name << "\" is not an image\n";
+        close();
+        return false;
+    }
+
+    auto& h = header();
+    if (h.version != image_version) {
+        std::cerr << "vm: \"" << file_name << "\" is an image of version " << h.version << ", not " << image_version << "\n";
+        close();
+        return false;
+    }
+
+    if (h.code_offset % image_alignment || h.data_offset % image_alignment ||
+        h.symbols_offset % sizeof(unsigned int) ||
+        !fits(h.code_offset, static_cast<unsigned long long>(h.code_size) * sizeof(unsigned int)) ||
+        !fits(h.data_offset, static_cast<unsigned long long>(h.data_size) * sizeof(unsigned int)) ||
+        !fits(h.symbols_offset, static_cast<unsigned long long>(h.symbol_count) * sizeof(ImageSymbol) + h.names_size)) {
+        std::cerr << "vm: image \"" << file_name << "\" is truncated or corrupt\n";
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+std::unordered_map<std::string, unsigned int> Image::symbols() const {
+    auto& h = header();
+    auto table = reinterpret_cast<const ImageSymbol*>(bytes + h.symbols_offset);
+    auto names = bytes + h.symbols_offset + h.symbol_count * sizeof(ImageSymbol);
+
+    std::unordered_map<std::string, unsigned int> symbols;
+    for (unsigned int i = 0; i < h.symbol_count; i++) {
+        if (table[i].name_offset + static_cast<unsigned long long>(table[i].name_length) <= h.names_size) {
+            symbols.emplace(std::string(names + table[i].name_offset, table[i].name_length), table[i].address);
+        }
+    }
+
+    return symbols;
+}
+
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace pebble {
+
+// a program as the assembler writes it to disk, laid out so VM::load can map
+// it straight into memory:
+//
+//   ImageHeader
+//   code, at a multiple of image_alignment, loaded at address 0
+//   data, at a multiple of image_alignment, loaded at data_address
+//   symbol_count ImageSymbols, then their names back to back
+//
+// words are in host byte order. code and data are padded with zeros to
+// image_alignment, so mapping whole pages of them never picks up what follows
+const unsigned int image_magic = 0x4d494250; // "PBIM"
+const unsigned int image_version = 1;
+// the largest page size the sections can be mapped with, smaller pages work as well
+const unsigned int image_alignment = 16384;
+
+struct ImageHeader {
+    unsigned int magic;
+    unsigned int version;
+    // sizes in words, offsets in bytes from the start of the file
+    unsigned int code_size;
+    unsigned int data_size;
+    unsigned int data_address;
+    unsigned int symbol_count;
+    unsigned long long code_offset;
+    unsigned long long data_offset;
+    unsigned long long symbols_offset;
+    unsigned long long names_size;
+};
+
+struct ImageSymbol {
+    unsigned int address;
+    // from the first name
+    unsigned int name_offset;
+    unsigned int name_length;
+};
+
+// the words a program starts with in memory past its code, which the
+// assembler collects from data directives and the linker from objects. it's
+// one run of words from address, the gaps between what was added are zeros
+class DataSection {
+    unsigned int start = 0;
+    std::vector<unsigned int> contents;
+    // [start, end) of each add, to catch two that overlap
+    std::vector<std::pair<unsigned long long, unsigned long long>> added;
+
+public:
+    // false if the words overlap ones already added or run past the last address
+    bool add(unsigned int address, const std::vector<unsigned int>& words);
+
+    unsigned int address() const {
+        return start;
+    }
+
+    const std::vector<unsigned int>& words() const {
+        return contents;
+    }
+
+    bool empty() const {
+        return contents.empty();
+    }
+};
+
+// whether the file starts with image_magic
+bool is_image(const std::string& file_name);
+
+void write_image(std::ostream& out, const std::vector<unsigned int>& code, const std::vector<unsigned int>& data,
+                 unsigned int data_address, const std::unordered_map<std::string, unsigned int>& symbols);
+
+// an image file mapped read-only, see VM::load
+class Image {
+    int fd = -1;
+    const char* bytes = nullptr;
+    size_t size = 0;
+    // the file's contents where it can't be mapped
+    std::vector<char> buffer;
+
+    void close();
+
+public:
+    Image() = default;
+    ~Image();
+
+    Image(const Image&) = delete;
+    Image& operator=(const Image&) = delete;
+
+    // false with the reason on stderr if the file can't be read or isn't an
+    // image of this version
+    bool open(const std::string& file_name);
+
+    // the file the sections can be mapped from, -1 where they have to be copied
+    int descriptor() const {
+        return fd;
+    }
+
+    const ImageHeader& header() const {
+        return *reinterpret_cast<const ImageHeader*>(bytes);
+    }
+
+    const unsigned int* code() const {
+        return reinterpret_cast<const unsigned int*>(bytes + header().code_offset);
+    }
+
+    const unsigned int* data() const {
+        return reinterpret_cast<const unsigned int*>(bytes + header().data_offset);
+    }
+
+    std::unordered_map<std::string, unsigned int> symbols() const;
+};
+
+}
@@ -1 +1,115 @@
 #include "instruction.h"
+
+namespace pebble::Instruction {
+
+namespace {
+
+// source_type 1 is a register, which fits in the first word
+template<typename T>
+void encode_register_or_immediate(const T& instruction, unsigned int destination, std::vector<unsigned int>& code) {
+    if (instruction.source_type) {
+        code.push_back(encode(instruction.opcode, destination, instruction.source, false));
+    } else {
+        code.push_back(encode(instruction.opcode, destination, 0, true));
+        code.push_back(instruction.source);
+    }
+}
+
+template<typename T>
+void encode_address(const T& instruction, std::vector<unsigned int>& code) {
+    code.push_back(encode(instruction.opcode, 0, 0, true));
+    code.push_back(instruction.address);
+}
+
+}
+
+void encode(const Halt& instruction, std::vector<unsigned int>& code) {
+    code.push_back(encode(instruction.opcode, 0, 0, false));
+}
+
+void encode(const Load& instruction, std::vector<unsigned int>& code) {
+    code.push_back(encode(instruction.opcode, instruction.destination, 0, true, instruction.source_mode));
+    code.push_back(instruction.source);
+}
+
+void encode(const Store& instruction, std::vector<unsigned int>& code) {
+    code.push_back(encode(instruction.opcode, 0, instruction.source, true, instruction.destination_mode));
+    code.push_back(instruction.destination);
+}
+
+void encode(const Move& instruction, std::vector<unsigned int>& code) {
+    encode_register_or_immediate(instruction, instruction.destination, code);
+}
+
+#define ARITHMETIC_LOGIC_ENCODE(NAME) \
+void encode(const NAME& instruction, std::vector<unsigned int>& code) { \
+    encode_register_or_immediate(instruction, instruction.destination, code); \
+}
+
+ARITHMETIC_LOGIC_ENCODE(Add)
+ARITHMETIC_LOGIC_ENCODE(Subtract)
+ARITHMETIC_LOGIC_ENCODE(Multiply)
+ARITHMETIC_LOGIC_ENCODE(Divide)
+ARITHMETIC_LOGIC_ENCODE(Modulo)
+ARITHMETIC_LOGIC_ENCODE(And)
+ARITHMETIC_LOGIC_ENCODE(Or)
+ARITHMETIC_LOGIC_ENCODE(Not)
+ARITHMETIC_LOGIC_ENCODE(ShiftLeft)
+ARITHMETIC_LOGIC_ENCODE(ShiftRight)
+ARITHMETIC_LOGIC_ENCODE(GreaterThan)
+ARITHMETIC_LOGIC_ENCODE(GreaterThanOrEqualTo)
+ARITHMETIC_LOGIC_ENCODE(LessThan)
+ARITHMETIC_LOGIC_ENCODE(LessThanOrEqualTo)
+ARITHMETIC_LOGIC_ENCODE(EqualTo)
+ARITHMETIC_LOGIC_ENCODE(NotEqualTo)
+
+#define COUNTED_ENCODE(NAME) \
+void encode(const NAME& instruction, std::vector<unsigned int>& code) { \
+    encode_register_or_immediate(instruction, 0, code); \
+}
+
+COUNTED_ENCODE(VectorAdd)
+COUNTED_ENCODE(VectorSubtract)
+COUNTED_ENCODE(VectorMultiply)
+COUNTED_ENCODE(VectorMinimum)
+COUNTED_ENCODE(VectorMaximum)
+COUNTED_ENCODE(VectorSum)
+COUNTED_ENCODE(VectorDot)
+COUNTED_ENCODE(Copy)
+COUNTED_ENCODE(Fill)
+COUNTED_ENCODE(Compare)
+
+void encode(const Jump& instruction, std::vector<unsigned int>& code) {
+    encode_address(instruction, code);
+}
+
+void encode(const JumpIfZero& instruction, std::vector<unsigned int>& code) {
+    encode_address(instruction, code);
+}
+
+void encode(const JumpIfNonZero& instruction, std::vector<unsigned int>& code) {
+    encode_address(instruction, code);
+}
+
+void encode(const Call& instruction, std::vector<unsigned int>& code) {
+    encode_address(instruction, code);
+}
+
+void encode(const Return& instruction, std::vector<unsigned int>& code) {
+    code.push_back(encode(instruction.opcode, 0, 0, false));
+}
+
+void encode(const Push& instruction, std::vector<unsigned int>& code) {
+    encode_register_or_immediate(instruction, 0, code);
+}
+
+void encode(const Pop& instruction, std::vector<unsigned int>& code) {
+    code.push_back(encode(instruction.opcode, instruction.destination, 0, false));
+}
+
+void encode(const Native& instruction, std::vector<unsigned int>& code) {
+    code.push_back(encode(instruction.opcode, 0, 0, true));
+    code.push_back(instruction.index);
+}
+
+}
@@ -1,9 +1,73 @@
 #pragma once
 
+#include <vector>
+
 #include "opcode.h"
 
 namespace pebble::Instruction {
 
+// every instruction starts with one word packing its opcode, register fields
+// and flags, followed by a 32-bit immediate word only when it has an
+// immediate, address or frame pointer offset operand
+//
+//   bits 0-7    opcode
+//   bits 8-11   destination register
+//   bits 12-15  source register
+//   bit 16      an immediate word follows
+//   bit 17      the immediate is a frame pointer offset rather than an address
+const unsigned int opcode_mask = 0xff;
+const unsigned int register_mask = 0xf;
+const unsigned int destination_shift = 8;
+const unsigned int source_shift = 12;
+const unsigned int immediate_flag = 1 << 16;
+const unsigned int frame_pointer_offset_flag = 1 << 17;
+
+inline unsigned int opcode(unsigned int word) {
+    return word & opcode_mask;
+}
+
+inline unsigned int destination(unsigned int word) {
+    return (word >> destination_shift) & register_mask;
+}
+
+inline unsigned int source(unsigned int word) {
+    return (word >> source_shift) & register_mask;
+}
+
+inline bool has_immediate(unsigned int word) {
+    return word & immediate_flag;
+}
+
+inline unsigned int addressing_mode(unsigned int word) {
+    return word & frame_pointer_offset_flag ? Opcode::AddressingModeFramePointerOffset : Opcode::AddressingModeAddress;
+}
+
+// width in words of the instruction starting with word
+inline unsigned int width(unsigned int word) {
+    return has_immediate(word) ? 2 : 1;
+}
+
+// whether the immediate of the instruction starting with word is an address
+// in the program, which is what labels assemble to
+inline bool has_address(unsigned int word) {
+    auto op = opcode(word);
+    return has_immediate(word) &&
+           (op == Opcode::Jump || op == Opcode::JumpIfZero || op == Opcode::JumpIfNonZero || op == Opcode::Call ||
+            ((op == Opcode::Load || op == Opcode::Store) && addressing_mode(word) == Opcode::AddressingModeAddress));
+}
+
+inline unsigned int encode(unsigned int opcode, unsigned int destination, unsigned int source, bool has_immediate,
+                           unsigned int addressing_mode = Opcode::AddressingModeAddress) {
+    return opcode |
+           destination << destination_shift |
+           source << source_shift |
+           (has_immediate ? immediate_flag : 0) |
+           (addressing_mode == Opcode::AddressingModeFramePointerOffset ? frame_pointer_offset_flag : 0);
+}
+
+// the operands of each instruction as the assembler builds them, encode packs
+// them into code
+
 struct Halt {
     unsigned int opcode = Opcode::Halt;
 };
@@ -35,7 +99,8 @@ struct NAME { \
     unsigned int destination; \
     unsigned int source_type; \
     unsigned int source; \
-}
+}; \
+void encode(const NAME& instruction, std::vector<unsigned int>& code)
 
 ARITHMETIC_LOGIC_INSTRUCTION(Add);
 ARITHMETIC_LOGIC_INSTRUCTION(Subtract);
@@ -89,4 +154,44 @@ struct Pop {
     unsigned int destination;
 };
 
-}
\ No newline at end of file
+struct Native {
+    unsigned int opcode = Opcode::Native;
+    unsigned int index;
+};
+
+// count words from the address in a, and for all but VectorSum and Fill the
+// same number from the address in b, with the count in a register or the
+// immediate
+#define COUNTED_INSTRUCTION(NAME) \
+struct NAME { \
+    unsigned int opcode = Opcode::NAME; \
+    unsigned int source_type; \
+    unsigned int source; \
+}; \
+void encode(const NAME& instruction, std::vector<unsigned int>& code)
+
+COUNTED_INSTRUCTION(VectorAdd);
+COUNTED_INSTRUCTION(VectorSubtract);
+COUNTED_INSTRUCTION(VectorMultiply);
+COUNTED_INSTRUCTION(VectorMinimum);
+COUNTED_INSTRUCTION(VectorMaximum);
+COUNTED_INSTRUCTION(VectorSum);
+COUNTED_INSTRUCTION(VectorDot);
+COUNTED_INSTRUCTION(Copy);
+COUNTED_INSTRUCTION(Fill);
+COUNTED_INSTRUCTION(Compare);
+
+void encode(const Halt& instruction, std::vector<unsigned int>& code);
+void encode(const Load& instruction, std::vector<unsigned int>& code);
+void encode(const Store& instruction, std::vector<unsigned int>& code);
+void encode(const Move& instruction, std::vector<unsigned int>& code);
+void encode(const Jump& instruction, std::vector<unsigned int>& code);
+void encode(const JumpIfZero& instruction, std::vector<unsigned int>& code);
+void encode(const JumpIfNonZero& instruction, std::vector<unsigned int>& code);
+void encode(const Call& instruction, std::vector<unsigned int>& code);
+void encode(const Return& instruction, std::vector<unsigned int>& code);
+void encode(const Push& instruction, std::vector<unsigned int>& code);
+void encode(const Pop& instruction, std::vector<unsigned int>& code);
+void encode(const Native& instruction, std::vector<unsigned int>& code);
+
+}
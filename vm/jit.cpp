@@ -0,0 +1,776 @@
+#include "jit.h"
+#include "vm.h"
+
+#ifdef PEBBLE_JIT_ENABLED
+
+#include <cstring>
+
+#include <sys/mman.h>
+
+namespace pebble {
+
+namespace {
+
+const size_t buffer_size = 1 << 20;
+const unsigned int max_block_instructions = 64;
+const unsigned int max_block_span = max_block_instructions * max_instruction_width;
+
+enum HostRegister {
+    rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+    r8, r9, r10, r11, r12, r13, r14, r15
+};
+
+// rbx holds the memory base and rbp the context, both callee saved like the
+// pebble registers so calls out of a block don't disturb them
+const int host_registers[NumRegisters] = {
+        r12, // RegisterA
+        r13, // RegisterB
+        -1,  // RegisterIP, never an operand of a compiled instruction
+        r14, // RegisterSP
+        r15, // RegisterFP
+};
+
+enum Condition {
+    Below = 0x2,
+    AboveOrEqual = 0x3,
+    Equal = 0x4,
+    NotEqual = 0x5,
+    BelowOrEqual = 0x6,
+    Above = 0x7,
+    Greater = 0xf,
+};
+
+// ModRM extensions of the 0x81 (immediate), 0xC1/0xD3 (shift) and 0xF7 (unary) groups
+enum Extension {
+    ExtensionAdd = 0,
+    ExtensionOr = 1,
+    ExtensionAnd = 4,
+    ExtensionSubtract = 5,
+    ExtensionCompare = 7,
+    ExtensionShiftLeft = 4,
+    ExtensionShiftRight = 5,
+    ExtensionNot = 2,
+    ExtensionDivide = 6,
+};
+
+// only what the blocks need, all operations are 32 bit unless noted
+class Emitter {
+    void rex(bool wide, int reg, int index, int base) {
+        unsigned char prefix = 0x40 | (wide << 3) | ((reg >> 3) & 1) << 2 | ((index >> 3) & 1) << 1 | ((base >> 3) & 1);
+        if (prefix != 0x40) {
+            byte(prefix);
+        }
+    }
+
+    void modrm_register(int reg, int rm) {
+        byte(0xc0 | (reg & 7) << 3 | (rm & 7));
+    }
+
+    // [rbx + index * 4]
+    void modrm_memory(int reg, int index) {
+        byte(0x04 | (reg & 7) << 3);
+        byte(0x80 | (index & 7) << 3 | rbx);
+    }
+
+    // [rbp + offset]
+    void modrm_context(int reg, size_t offset) {
+        byte(0x40 | (reg & 7) << 3 | rbp);
+        byte(offset);
+    }
+
+public:
+    std::vector<unsigned char> code;
+
+    size_t size() const {
+        return code.size();
+    }
+
+    void byte(unsigned int b) {
+        code.push_back(b);
+    }
+
+    void dword(unsigned int d) {
+        for (int i = 0; i < 4; i++) {
+            byte((d >> (i * 8)) & 0xff);
+        }
+    }
+
+    void qword(unsigned long long q) {
+        dword(q);
+        dword(q >> 32);
+    }
+
+    // op r/m, r with the destination in r/m
+    void op_register(unsigned char opcode, int destination, int source) {
+        rex(false, source, 0, destination);
+        byte(opcode);
+        modrm_register(source, destination);
+    }
+
+    void move(int destination, int source) {
+        op_register(0x89, destination, source);
+    }
+
+    void move_immediate(int destination, unsigned int value) {
+        rex(false, 0, 0, destination);
+        byte(0xb8 + (destination & 7));
+        dword(value);
+    }
+
+    void op_immediate(Extension extension, int destination, unsigned int value) {
+        rex(false, 0, 0, destination);
+        byte(0x81);
+        modrm_register(extension, destination);
+        dword(value);
+    }
+
+    void multiply(int destination, int source) {
+        rex(false, destination, 0, source);
+        byte(0x0f);
+        byte(0xaf);
+        modrm_register(destination, source);
+    }
+
+    void multiply_immediate(int destination, unsigned int value) {
+        rex(false, destination, 0, destination);
+        byte(0x69);
+        modrm_register(destination, destination);
+        dword(value);
+    }
+
+    void unary(Extension extension, int reg) {
+        rex(false, 0, 0, reg);
+        byte(0xf7);
+        modrm_register(extension, reg);
+    }
+
+    void shift_by_cl(Extension extension, int reg) {
+        rex(false, 0, 0, reg);
+        byte(0xd3);
+        modrm_register(extension, reg);
+    }
+
+    void shift_immediate(Extension extension, int reg, unsigned int count) {
+        rex(false, 0, 0, reg);
+        byte(0xc1);
+        modrm_register(extension, reg);
+        byte(count);
+    }
+
+    // setcc al, movzx destination, al
+    void set_if(Condition condition, int destination) {
+        byte(0x0f);
+        byte(0x90 + condition);
+        modrm_register(0, rax);
+        rex(false, destination, 0, 0);
+        byte(0x0f);
+        byte(0xb6);
+        modrm_register(destination, rax);
+    }
+
+    void load(int destination, int index) {
+        rex(false, destination, index, rbx);
+        byte(0x8b);
+        modrm_memory(destination, index);
+    }
+
+    void store(int index, int source) {
+        rex(false, source, index, rbx);
+        byte(0x89);
+        modrm_memory(source, index);
+    }
+
+    void store_immediate(int index, unsigned int value) {
+        rex(false, 0, index, rbx);
+        byte(0xc7);
+        modrm_memory(0, index);
+        dword(value);
+    }
+
+    void load_context(int destination, size_t offset, bool wide = false) {
+        rex(wide, destination, 0, rbp);
+        byte(0x8b);
+        modrm_context(destination, offset);
+    }
+
+    void store_context(size_t offset, int source) {
+        rex(false, source, 0, rbp);
+        byte(0x89);
+        modrm_context(source, offset);
+    }
+
+    void store_context_immediate(size_t offset, unsigned int value) {
+        byte(0xc7);
+        modrm_context(0, offset);
+        dword(value);
+    }
+
+    // 64 bit
+    void subtract_context_immediate(size_t offset, unsigned int value) {
+        rex(true, 0, 0, rbp);
+        byte(0x81);
+        modrm_context(ExtensionSubtract, offset);
+        dword(value);
+    }
+
+    void push(int reg) {
+        rex(false, 0, 0, reg);
+        byte(0x50 + (reg & 7));
+    }
+
+    void pop(int reg) {
+        rex(false, 0, 0, reg);
+        byte(0x58 + (reg & 7));
+    }
+
+    // jumps return where their rel32 is so it can be patched once the target is known
+    size_t jump() {
+        byte(0xe9);
+        dword(0);
+        return size() - 4;
+    }
+
+    size_t jump_if(Condition condition) {
+        byte(0x0f);
+        byte(0x80 + condition);
+        dword(0);
+        return size() - 4;
+    }
+
+    void patch(size_t at, size_t target) {
+        auto rel = static_cast<unsigned int>(target - (at + 4));
+        std::memcpy(code.data() + at, &rel, 4);
+    }
+};
+
+bool is_control(Handler handler) {
+    switch (handler) {
+        case Handler::Jump:
+        case Handler::JumpIfZero:
+        case Handler::JumpIfNonZero:
+        case Handler::Call:
+        case Handler::Return:
+            return true;
+        default:
+            return false;
+    }
+}
+
+#define ARITHMETIC_LOGIC_HANDLER_CASES(NAME, OPERATOR) \
+case Handler::NAME##Register: \
+case Handler::NAME##Immediate:
+
+bool is_supported(Handler handler, const DecodedInstruction& instruction) {
+    // leave the division by zero to the interpreter
+    if ((handler == Handler::DivideImmediate || handler == Handler::ModuloImmediate) && instruction.operand == 0) {
+        return false;
+    }
+
+    switch (handler) {
+        ARITHMETIC_LOGIC_OPERATIONS(ARITHMETIC_LOGIC_HANDLER_CASES)
+        case Handler::LoadAddress:
+        case Handler::LoadFramePointerOffset:
+        case Handler::StoreAddress:
+        case Handler::StoreFramePointerOffset:
+        case Handler::MoveRegister:
+        case Handler::MoveImmediate:
+        case Handler::NotRegister:
+        case Handler::NotImmediate:
+        case Handler::PushRegister:
+        case Handler::PushImmediate:
+        case Handler::Pop:
+        case Handler::Jump:
+        case Handler::JumpIfZero:
+        case Handler::JumpIfNonZero:
+        case Handler::Call:
+        case Handler::Return:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// emits the code for one block, see Jit::compile
+class BlockCompiler {
+    Emitter e;
+    unsigned int code_size;
+    // native offset of every instruction compiled so far, for jumps back into the block
+    std::vector<std::pair<unsigned int, size_t>> instruction_offsets;
+    std::vector<size_t> epilogue_fixups;
+    void (*code_written)(JitContext*, unsigned int);
+
+    void exit(unsigned int ip) {
+        e.move_immediate(rax, ip);
+        epilogue_fixups.push_back(e.jump());
+    }
+
+    // exit and have the interpreter run the instruction at ip
+    void exit_to_interpreter(unsigned int ip) {
+        e.store_context_immediate(offsetof(JitContext, interpret), 1);
+        exit(ip);
+    }
+
+    // a target inside the block is a loop, each pass charges the words from
+    // the target to next and the block exits once the fuel runs out
+    void jump_to(unsigned int target, unsigned int next) {
+        for (auto& [address, offset] : instruction_offsets) {
+            if (address == target) {
+                e.subtract_context_immediate(offsetof(JitContext, fuel), next - target);
+                e.patch(e.jump_if(Greater), offset);
+                exit(target);
+                return;
+            }
+        }
+        exit(target);
+    }
+
+    // the address just written is in eax, writes into the code region, the
+    // halt it runs off onto included, have to invalidate what was decoded and
+    // compiled from it. the program isn't verified after one, so the block is
+    // left and run_jit hands the rest of the run to the checked path
+    void check_code_write(unsigned int next, bool known_in_code = false) {
+        size_t not_code = 0;
+        if (!known_in_code) {
+            e.op_immediate(ExtensionCompare, rax, code_size);
+            not_code = e.jump_if(Above);
+        }
+
+        // code_written(context, address)
+        e.byte(0x48);
+        e.op_register(0x89, rdi, rbp);
+        e.move(rsi, rax);
+        e.byte(0x48);
+        e.byte(0xb8);
+        e.qword(reinterpret_cast<unsigned long long>(code_written));
+        e.byte(0xff);
+        e.byte(0xd0);
+        exit_to_interpreter(next);
+
+        if (!known_in_code) {
+            e.patch(not_code, e.size());
+        }
+    }
+
+    void push_value(const DecodedInstruction& instruction, bool is_register, unsigned int next) {
+        e.move(rax, r14);
+        if (is_register) {
+            e.store(r14, host_registers[instruction.reg]);
+        } else {
+            e.store_immediate(r14, instruction.operand);
+        }
+        e.op_immediate(ExtensionSubtract, r14, 1);
+        check_code_write(next);
+    }
+
+    // address of a frame pointer relative operand into eax
+    void frame_pointer_address(unsigned int offset) {
+        e.move(rax, r15);
+        e.op_immediate(ExtensionAdd, rax, offset);
+    }
+
+    void compare(Condition condition, int destination, const DecodedInstruction& instruction, bool is_register) {
+        if (is_register) {
+            e.op_register(0x39, destination, host_registers[instruction.operand]);
+        } else {
+            e.op_immediate(ExtensionCompare, destination, instruction.operand);
+        }
+        e.set_if(condition, destination);
+    }
+
+    void divide(unsigned int address, int destination, const DecodedInstruction& instruction, bool is_register,
+                bool remainder) {
+        int divisor = rcx;
+        if (is_register) {
+            divisor = host_registers[instruction.operand];
+            e.op_register(0x85, divisor, divisor);
+            auto not_zero = e.jump_if(NotEqual);
+            exit_to_interpreter(address);
+            e.patch(not_zero, e.size());
+        } else {
+            e.move_immediate(rcx, instruction.operand);
+        }
+
+        e.move(rax, destination);
+        e.op_register(0x31, rdx, rdx);
+        e.unary(ExtensionDivide, divisor);
+        e.move(destination, remainder ? rdx : rax);
+    }
+
+    void shift(Extension extension, int destination, const DecodedInstruction& instruction, bool is_register) {
+        if (is_register) {
+            e.move(rcx, host_registers[instruction.operand]);
+            e.shift_by_cl(extension, destination);
+        } else if (instruction.operand & 31) {
+            // x86 masks the count like the interpreter's shifts do when compiled for it
+            e.shift_immediate(extension, destination, instruction.operand & 31);
+        }
+    }
+
+    void binary(unsigned char opcode, Extension extension, int destination, const DecodedInstruction& instruction,
+                bool is_register) {
+        if (is_register) {
+            e.op_register(opcode, destination, host_registers[instruction.operand]);
+        } else {
+            e.op_immediate(extension, destination, instruction.operand);
+        }
+    }
+
+public:
+    BlockCompiler(unsigned int code_size, void (*code_written)(JitContext*, unsigned int))
+            : code_size(code_size), code_written(code_written) {
+        for (auto reg : {rbx, rbp, r12, r13, r14, r15}) {
+            e.push(reg);
+        }
+        // keep the stack 16 byte aligned for calls out of the block
+        e.byte(0x48);
+        e.byte(0x83);
+        e.byte(0xec);
+        e.byte(0x08);
+
+        e.byte(0x48);
+        e.op_register(0x89, rbp, rdi);
+        e.load_context(rbx, offsetof(JitContext, memory), true);
+        e.load_context(r12, offsetof(JitContext, a));
+        e.load_context(r13, offsetof(JitContext, b));
+        e.load_context(r14, offsetof(JitContext, sp));
+        e.load_context(r15, offsetof(JitContext, fp));
+    }
+
+    void add(Handler handler, const DecodedInstruction& instruction, unsigned int address) {
+        instruction_offsets.emplace_back(address, e.size());
+
+        auto next = address + instruction.width;
+        auto reg = host_registers[instruction.reg];
+
+        switch (handler) {
+            case Handler::LoadAddress:
+                e.move_immediate(rax, instruction.operand);
+                e.load(reg, rax);
+                break;
+            case Handler::LoadFramePointerOffset:
+                frame_pointer_address(instruction.operand);
+                e.load(reg, rax);
+                break;
+            case Handler::StoreAddress:
+                e.move_immediate(rax, instruction.operand);
+                e.store(rax, reg);
+                if (instruction.operand <= code_size) {
+                    check_code_write(next, true);
+                }
+                break;
+            case Handler::StoreFramePointerOffset:
+                frame_pointer_address(instruction.operand);
+                e.store(rax, reg);
+                check_code_write(next);
+                break;
+            case Handler::MoveRegister:
+                e.move(reg, host_registers[instruction.operand]);
+                break;
+            case Handler::MoveImmediate:
+                e.move_immediate(reg, instruction.operand);
+                break;
+            case Handler::AddRegister:
+            case Handler::AddImmediate:
+                binary(0x01, ExtensionAdd, reg, instruction, handler == Handler::AddRegister);
+                break;
+            case Handler::SubtractRegister:
+            case Handler::SubtractImmediate:
+                binary(0x29, ExtensionSubtract, reg, instruction, handler == Handler::SubtractRegister);
+                break;
+            case Handler::AndRegister:
+            case Handler::AndImmediate:
+                binary(0x21, ExtensionAnd, reg, instruction, handler == Handler::AndRegister);
+                break;
+            case Handler::OrRegister:
+            case Handler::OrImmediate:
+                binary(0x09, ExtensionOr, reg, instruction, handler == Handler::OrRegister);
+                break;
+            case Handler::MultiplyRegister:
+                e.multiply(reg, host_registers[instruction.operand]);
+                break;
+            case Handler::MultiplyImmediate:
+                e.multiply_immediate(reg, instruction.operand);
+                break;
+            case Handler::DivideRegister:
+            case Handler::DivideImmediate:
+                divide(address, reg, instruction, handler == Handler::DivideRegister, false);
+                break;
+            case Handler::ModuloRegister:
+            case Handler::ModuloImmediate:
+                divide(address, reg, instruction, handler == Handler::ModuloRegister, true);
+                break;
+            case Handler::ShiftLeftRegister:
+            case Handler::ShiftLeftImmediate:
+                shift(ExtensionShiftLeft, reg, instruction, handler == Handler::ShiftLeftRegister);
+                break;
+            case Handler::ShiftRightRegister:
+            case Handler::ShiftRightImmediate:
+                shift(ExtensionShiftRight, reg, instruction, handler == Handler::ShiftRightRegister);
+                break;
+            case Handler::GreaterThanRegister:
+            case Handler::GreaterThanImmediate:
+                compare(Above, reg, instruction, handler == Handler::GreaterThanRegister);
+                break;
+            case Handler::GreaterThanOrEqualToRegister:
+            case Handler::GreaterThanOrEqualToImmediate:
+                compare(AboveOrEqual, reg, instruction, handler == Handler::GreaterThanOrEqualToRegister);
+                break;
+            case Handler::LessThanRegister:
+            case Handler::LessThanImmediate:
+                compare(Below, reg, instruction, handler == Handler::LessThanRegister);
+                break;
+            case Handler::LessThanOrEqualToRegister:
+            case Handler::LessThanOrEqualToImmediate:
+                compare(BelowOrEqual, reg, instruction, handler == Handler::LessThanOrEqualToRegister);
+                break;
+            case Handler::EqualToRegister:
+            case Handler::EqualToImmediate:
+                compare(Equal, reg, instruction, handler == Handler::EqualToRegister);
+                break;
+            case Handler::NotEqualToRegister:
+            case Handler::NotEqualToImmediate:
+                compare(NotEqual, reg, instruction, handler == Handler::NotEqualToRegister);
+                break;
+            case Handler::NotRegister:
+                e.unary(ExtensionNot, reg);
+                break;
+            case Handler::NotImmediate:
+                e.move_immediate(reg, ~instruction.operand);
+                break;
+            case Handler::PushRegister:
+            case Handler::PushImmediate:
+                push_value(instruction, handler == Handler::PushRegister, next);
+                break;
+            case Handler::Pop:
+                e.op_immediate(ExtensionAdd, r14, 1);
+                e.load(reg, r14);
+                break;
+            case Handler::Jump:
+                jump_to(instruction.operand, next);
+                break;
+            case Handler::JumpIfZero:
+            case Handler::JumpIfNonZero: {
+                e.op_register(0x85, r12, r12);
+                auto taken = e.jump_if(handler == Handler::JumpIfZero ? Equal : NotEqual);
+                exit(next);
+                e.patch(taken, e.size());
+                jump_to(instruction.operand, next);
+                break;
+            }
+            case Handler::Call:
+                push_value(DecodedInstruction{.operand = next}, false, instruction.operand);
+                exit(instruction.operand);
+                break;
+            case Handler::Return:
+                e.op_immediate(ExtensionAdd, r14, 1);
+                e.load(rax, r14);
+                epilogue_fixups.push_back(e.jump());
+                break;
+            default:
+                break;
+        }
+    }
+
+    std::vector<unsigned char>& finish(bool ended, unsigned int next) {
+        if (!ended) {
+            exit(next);
+        }
+
+        for (auto fixup : epilogue_fixups) {
+            e.patch(fixup, e.size());
+        }
+
+        e.store_context(offsetof(JitContext, a), r12);
+        e.store_context(offsetof(JitContext, b), r13);
+        e.store_context(offsetof(JitContext, sp), r14);
+        e.store_context(offsetof(JitContext, fp), r15);
+
+        e.byte(0x48);
+        e.byte(0x83);
+        e.byte(0xc4);
+        e.byte(0x08);
+        for (auto reg : {r15, r14, r13, r12, rbp, rbx}) {
+            e.pop(reg);
+        }
+        e.byte(0xc3);
+
+        return e.code;
+    }
+};
+
+}
+
+Jit::Jit(unsigned int code_size) : code_size(code_size), entries(code_size) {
+    auto memory = mmap(nullptr, buffer_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED) {
+        buffer = static_cast<unsigned char*>(memory);
+    }
+}
+
+Jit::~Jit() {
+    if (buffer) {
+        munmap(buffer, buffer_size);
+    }
+}
+
+void Jit::code_written(JitContext* context, unsigned int address) {
+    context->vm->invalidate(address);
+}
+
+void Jit::flush() {
+    entries.assign(code_size, Entry{});
+    buffer_used = 0;
+}
+
+void Jit::invalidate(unsigned int address) {
+    auto first = address < max_block_span ? 0 : address - max_block_span + 1;
+    for (auto i = first; i <= address; i++) {
+        if (entries[i].compiled && entries[i].end > address) {
+            entries[i] = Entry{};
+        }
+    }
+}
+
+void Jit::compile(VM& vm, unsigned int start) {
+    BlockCompiler compiler(code_size, code_written);
+    auto address = start;
+    unsigned int count = 0;
+    bool ended = false;
+
+    while (count < max_block_instructions && address < code_size) {
+        if (vm.decoded[address].handler == Handler::Undecoded) {
+            vm.decode_record(address);
+        }
+
+        auto& instruction = vm.decoded[address];
+        auto handler = unfused(instruction.handler);
+        if (!is_supported(handler, instruction)) {
+            break;
+        }
+
+        compiler.add(handler, instruction, address);
+        count++;
+        address += instruction.width;
+
+        if (is_control(handler)) {
+            ended = true;
+            break;
+        }
+    }
+
+    auto& entry = entries[start];
+
+    if (count == 0 || !buffer) {
+        entry = Entry{.end = start + 1, .compiled = true};
+        return;
+    }
+
+    auto& code = compiler.finish(ended, address);
+    if (code.size() > buffer_size) {
+        entry = Entry{.end = start + 1, .compiled = true};
+        return;
+    }
+
+    if (buffer_used + code.size() > buffer_size) {
+        flush();
+    }
+
+    mprotect(buffer, buffer_size, PROT_READ | PROT_WRITE);
+    std::memcpy(buffer + buffer_used, code.data(), code.size());
+    mprotect(buffer, buffer_size, PROT_READ | PROT_EXEC);
+
+    entries[start] = Entry{
+            .block = reinterpret_cast<Block>(buffer + buffer_used),
+            .end = address,
+            .compiled = true
+    };
+    buffer_used += code.size();
+}
+
+const Jit::Entry* Jit::lookup(VM& vm, unsigned int address) {
+    if (!entries[address].compiled) {
+        compile(vm, address);
+    }
+
+    auto& entry = entries[address];
+    return entry.block ? &entry : nullptr;
+}
+
+// a block is charged for the words it covers each time it's entered, or up
+// to where it stopped if it handed over to the interpreter
+RunStatus VM::run_jit(long long& fuel) {
+    if (!jit) {
+        return run_threaded(fuel);
+    }
+
+    auto& ip = registers[RegisterIP];
+    JitContext context{
+            .memory = memory.data(),
+            .vm = this,
+            .a = registers[RegisterA],
+            .b = registers[RegisterB],
+            .sp = registers[RegisterSP],
+            .fp = registers[RegisterFP],
+            .fuel = fuel
+    };
+
+    auto status = RunStatus::Halted;
+    while (true) {
+        if (ip < code_size && context.fuel > 0 && verification.verified) {
+            if (auto entry = jit->lookup(*this, ip)) {
+                // a write into the block drops its entry while it runs
+                auto end = entry->end;
+                trace.record(ip, memory[ip], context.a, context.b, context.sp);
+                context.block_start = ip;
+                context.interpret = 0;
+                ip = entry->block(&context);
+
+                if (!context.interpret) {
+                    context.fuel -= end - context.block_start;
+                    continue;
+                }
+                context.fuel -= ip - context.block_start;
+            }
+        }
+
+        registers[RegisterA] = context.a;
+        registers[RegisterB] = context.b;
+        registers[RegisterSP] = context.sp;
+        registers[RegisterFP] = context.fp;
+
+        if (Instruction::opcode(memory[ip]) == Opcode::Halt) {
+            break;
+        }
+        if (context.fuel <= 0 || !verification.verified) {
+            status = RunStatus::OutOfFuel;
+            break;
+        }
+
+        context.fuel -= Instruction::width(memory[ip]);
+        trace_instruction(ip, registers);
+        execute(memory[ip], registers);
+
+        context.a = registers[RegisterA];
+        context.b = registers[RegisterB];
+        context.sp = registers[RegisterSP];
+        context.fp = registers[RegisterFP];
+    }
+
+    fuel = context.fuel;
+    return status;
+}
+
+}
+
+#else
+
+namespace pebble {
+
+// not built for this platform
+RunStatus VM::run_jit(long long& fuel) {
+    return run_threaded(fuel);
+}
+
+}
+
+#endif
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "decoder.h"
+
+#if defined(PEBBLE_JIT) && defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define PEBBLE_JIT_ENABLED
+#endif
+
+namespace pebble {
+
+class VM;
+
+#ifdef PEBBLE_JIT_ENABLED
+
+// state shared between VM::run_jit and the compiled blocks, which keep a, b,
+// sp and fp in host registers while they run and write them back on exit
+struct JitContext {
+    unsigned int* memory;
+    VM* vm;
+    unsigned int a;
+    unsigned int b;
+    unsigned int sp;
+    unsigned int fp;
+    // where the running block started, which its words are charged from
+    unsigned int block_start;
+    // set when a block exits because the interpreter has to run the instruction at the returned ip
+    unsigned int interpret;
+    // the budget left, loops inside a block charge it and exit once it runs out
+    long long fuel;
+};
+
+// compiles straight-line runs of decoded instructions, up to and including
+// the first jump, call or return, into x86-64 code
+class Jit {
+    using Block = unsigned int (*)(JitContext* context);
+
+    struct Entry {
+        Block block = nullptr;
+        // one past the last word the block was compiled from
+        unsigned int end = 0;
+        bool compiled = false;
+    };
+
+    unsigned int code_size;
+    // indexed by the address the block starts at
+    std::vector<Entry> entries;
+
+    unsigned char* buffer = nullptr;
+    size_t buffer_used = 0;
+
+    void compile(VM& vm, unsigned int address);
+    void flush();
+
+    static void code_written(JitContext* context, unsigned int address);
+
+public:
+    explicit Jit(unsigned int code_size);
+    ~Jit();
+
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    // the block starting at address, compiling it on first use, nullptr if the
+    // instruction there has to be interpreted
+    const Entry* lookup(VM& vm, unsigned int address);
+
+    // drops the blocks compiled from the word at address
+    void invalidate(unsigned int address);
+};
+
+#else
+
+class Jit {
+};
+
+#endif
+
+}
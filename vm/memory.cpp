@@ -0,0 +1,404 @@
+#include <algorithm>
+#include <cassert>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "memory.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PEBBLE_MMAP_MEMORY
+#include <sys/mman.h>
+#endif
+
+#ifdef PEBBLE_MMAP_MEMORY
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace pebble {
+
+Memory::Memory(const MemoryConfig& config) : word_count(config.size) {
+    assert(config.size > 0 && config.size <= max_memory_size);
+    auto bytes = word_count * sizeof(unsigned int);
+
+#ifdef PEBBLE_MMAP_MEMORY
+    // anonymous pages read as zero and are only allocated on first write
+    auto mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "vm: failed to map " << bytes << " bytes of memory\n";
+        assert(false);
+        return;
+    }
+
+#ifdef MADV_HUGEPAGE
+    if (config.huge_pages) {
+        madvise(mapping, bytes, MADV_HUGEPAGE);
+    }
+#endif
+
+    words = static_cast<unsigned int*>(mapping);
+    place_guard(config.stack_size);
+#else
+    words = static_cast<unsigned int*>(std::calloc(word_count, sizeof(unsigned int)));
+    if (!words) {
+        std::cerr << "vm: failed to allocate " << bytes << " bytes of memory\n";
+        assert(false);
+    }
+#endif
+}
+
+#ifdef __linux__
+Memory::Memory(const MemoryImage& image) : word_count(image.word_count) {
+    auto bytes = word_count * sizeof(unsigned int);
+
+    // a private mapping reads through to the image until a page is written
+    auto mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_NORESERVE, image.fd, 0);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "vm: failed to map " << bytes << " bytes of memory from an image\n";
+        assert(false);
+        return;
+    }
+
+    words = static_cast<unsigned int*>(mapping);
+    place_guard(image.stack_size);
+    // pages of the image that haven't been touched aren't in the page table,
+    // so an image taken from this memory has to start from this one
+    image_fd = fcntl(image.fd, F_DUPFD_CLOEXEC, 0);
+}
+#else
+// the guard page is in the same place in both
+Memory::Memory(const MemoryImage& image) : Memory(MemoryConfig{.size = image.size(), .stack_size = image.words.stack_size}) {
+    std::copy(image.words.data(), image.words.data() + guard_start, words);
+    std::copy(image.words.data() + guard_end, image.words.data() + word_count, words + guard_end);
+}
+#endif
+
+Memory::~Memory() {
+    release();
+}
+
+Memory::Memory(Memory&& other) noexcept
+        : words(std::exchange(other.words, nullptr)), word_count(std::exchange(other.word_count, 0)),
+          image_fd(std::exchange(other.image_fd, -1)), file_ranges(std::move(other.file_ranges)),
+          stack_size(std::exchange(other.stack_size, 0)), guard_start(std::exchange(other.guard_start, 0)),
+          guard_end(std::exchange(other.guard_end, 0)) {}
+
+Memory& Memory::operator=(Memory&& other) noexcept {
+    if (this != &other) {
+        release();
+        words = std::exchange(other.words, nullptr);
+        word_count = std::exchange(other.word_count, 0);
+        image_fd = std::exchange(other.image_fd, -1);
+        file_ranges = std::move(other.file_ranges);
+        stack_size = std::exchange(other.stack_size, 0);
+        guard_start = std::exchange(other.guard_start, 0);
+        guard_end = std::exchange(other.guard_end, 0);
+    }
+    return *this;
+}
+
+// the stack gets at least stack_size words, its bottom is rounded down to a page
+void Memory::place_guard(unsigned long long size) {
+    stack_size = size;
+
+#ifdef PEBBLE_MMAP_MEMORY
+    unsigned long long page_size = sysconf(_SC_PAGESIZE);
+    auto bytes = word_count * sizeof(unsigned int);
+    auto stack_bytes = stack_size * sizeof(unsigned int);
+    if (stack_size == 0 || stack_bytes + page_size > bytes) {
+        return;
+    }
+
+    auto end = (bytes - stack_bytes) / page_size * page_size;
+    auto start = end - page_size;
+    if (mprotect(reinterpret_cast<char*>(words) + start, page_size, PROT_NONE) != 0) {
+        std::cerr << "vm: failed to protect the stack guard page, the stack isn't guarded\n";
+        return;
+    }
+
+    guard_start = start / sizeof(unsigned int);
+    guard_end = end / sizeof(unsigned int);
+#endif
+}
+
+void Memory::load(unsigned int address, const unsigned int* source, unsigned int count, int fd,
+                  unsigned long long offset) {
+    assert(address + static_cast<unsigned long long>(count) <= word_count);
+    assert(count == 0 || address + static_cast<unsigned long long>(count) <= guard_start || address >= guard_end);
+
+#ifdef PEBBLE_MMAP_MEMORY
+    unsigned long long page_size = sysconf(_SC_PAGESIZE);
+    auto start = address * sizeof(unsigned int);
+    // whole pages, the file has to be padded with zeros up to the next one
+    auto length = (count * sizeof(unsigned int) + page_size - 1) / page_size * page_size;
+
+    if (fd >= 0 && count > 0 && start % page_size == 0 && offset % page_size == 0 &&
+        start + length <= word_count * sizeof(unsigned int)) {
+        auto mapping = mmap(reinterpret_cast<char*>(words) + start, length, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_FIXED, fd, offset);
+        if (mapping != MAP_FAILED) {
+            file_ranges.emplace_back(start, length);
+            return;
+        }
+    }
+#endif
+
+    std::copy(source, source + count, words + address);
+}
+
+void Memory::release() {
+#ifdef __linux__
+    if (image_fd >= 0) {
+        close(image_fd);
+        image_fd = -1;
+    }
+#endif
+
+    if (!words) {
+        return;
+    }
+
+#ifdef PEBBLE_MMAP_MEMORY
+    munmap(words, word_count * sizeof(unsigned int));
+#else
+    std::free(words);
+#endif
+
+    words = nullptr;
+}
+
+#ifdef __linux__
+
+namespace {
+
+// which pages of the range hold data of the process's own, resident or swapped
+// out, rather than nothing or pages of a mapped file. from the kernel's page
+// table dump, every page counts if it can't be read
+std::vector<bool> private_pages(const void* start, size_t pages, size_t page_size) {
+    std::vector<bool> touched(pages, true);
+
+    auto fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return touched;
+    }
+
+    const size_t chunk = 1 << 16;
+    const uint64_t present = 1ull << 63;
+    const uint64_t swapped = 1ull << 62;
+    const uint64_t file = 1ull << 61;
+    std::vector<uint64_t> entries(chunk);
+    auto first = reinterpret_cast<uintptr_t>(start) / page_size;
+
+    for (size_t page = 0; page < pages; page += chunk) {
+        auto count = std::min(chunk, pages - page);
+        auto bytes = count * sizeof(uint64_t);
+        if (pread(fd, entries.data(), bytes, (first + page) * sizeof(uint64_t)) != static_cast<ssize_t>(bytes)) {
+            break;
+        }
+        for (size_t i = 0; i < count; i++) {
+            touched[page + i] = (entries[i] & (present | swapped)) && !(entries[i] & file);
+        }
+    }
+
+    close(fd);
+    return touched;
+}
+
+bool all_zero(const char* bytes, size_t count) {
+    return std::all_of(bytes, bytes + count, [](char byte) { return byte == 0; });
+}
+
+bool write_all(int fd, const char* bytes, size_t length, off_t offset) {
+    for (size_t done = 0; done < length;) {
+        auto result = pwrite(fd, bytes + done, length - done, offset + done);
+        if (result <= 0) {
+            return false;
+        }
+        done += result;
+    }
+    return true;
+}
+
+// copies the parts of from that hold data, skipping the holes
+bool copy_data(int from, int to, off_t size) {
+    std::vector<char> buffer(1 << 20);
+
+    for (off_t offset = lseek(from, 0, SEEK_DATA); offset >= 0 && offset < size;
+         offset = lseek(from, offset, SEEK_DATA)) {
+        auto end = std::min(lseek(from, offset, SEEK_HOLE), size);
+        while (offset < end) {
+            auto length = std::min<off_t>(buffer.size(), end - offset);
+            if (pread(from, buffer.data(), length, offset) != length ||
+                !write_all(to, buffer.data(), length, offset)) {
+                return false;
+            }
+            offset += length;
+        }
+    }
+
+    return true;
+}
+
+}
+
+// the file starts out as a hole that reads as zero, or as a copy of the image
+// the memory was mapped from, so only the pages written since need copying
+MemoryImage::MemoryImage(const Memory& memory) : word_count(memory.size()), stack_size(memory.stack_size) {
+    auto bytes = word_count * sizeof(unsigned int);
+
+    fd = memfd_create("pebble memory image", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, bytes) != 0 || (memory.image_fd >= 0 && !copy_data(memory.image_fd, fd, bytes))) {
+        std::cerr << "vm: failed to create a memory image of " << bytes << " bytes\n";
+        assert(false);
+        return;
+    }
+
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    auto pages = (bytes + page_size - 1) / page_size;
+    auto data = reinterpret_cast<const char*>(memory.data());
+    auto touched = private_pages(data, pages, page_size);
+
+    // pages of a mapped file that haven't been touched aren't in the page table either
+    for (auto& [start, length] : memory.file_ranges) {
+        std::fill(touched.begin() + start / page_size, touched.begin() + std::min((start + length) / page_size, pages), true);
+    }
+    // and the guard page can't be read, it's a hole in the file the same as in memory
+    std::fill(touched.begin() + memory.guard_start * sizeof(unsigned int) / page_size,
+              touched.begin() + memory.guard_end * sizeof(unsigned int) / page_size, false);
+
+    // zero pages only matter when they cover something from the earlier image
+    auto written_to = [&](size_t page) {
+        auto offset = page * page_size;
+        return touched[page] &&
+               (memory.image_fd >= 0 || !all_zero(data + offset, std::min<size_t>(page_size, bytes - offset)));
+    };
+
+    // runs of pages go out in one write each
+    for (size_t page = 0; page < pages;) {
+        if (!written_to(page)) {
+            page++;
+            continue;
+        }
+
+        auto end = page + 1;
+        while (end < pages && written_to(end)) {
+            end++;
+        }
+
+        auto offset = page * page_size;
+        auto length = std::min<size_t>(end * page_size, bytes) - offset;
+        if (!write_all(fd, data + offset, length, offset)) {
+            std::cerr << "vm: failed to write a memory image\n";
+            assert(false);
+            return;
+        }
+
+        page = end;
+    }
+}
+
+MemoryImage::~MemoryImage() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+unsigned long long MemoryImage::size() const {
+    return word_count;
+}
+
+#else
+
+MemoryImage::MemoryImage(const Memory& memory)
+        : words(MemoryConfig{.size = memory.size(), .stack_size = memory.stack_size}) {
+    std::copy(memory.data(), memory.data() + memory.guard_start, words.data());
+    std::copy(memory.data() + memory.guard_end, memory.data() + memory.size(), words.data() + memory.guard_end);
+}
+
+MemoryImage::~MemoryImage() = default;
+
+unsigned long long MemoryImage::size() const {
+    return words.size();
+}
+
+#endif
+
+#ifdef PEBBLE_GUARD_PAGES
+
+namespace {
+
+thread_local GuardedRun* current_run = nullptr;
+std::once_flag handler_installed;
+struct sigaction previous_segv_action;
+struct sigaction previous_bus_action;
+
+}
+
+void GuardedRun::on_fault(int signal, siginfo_t* info, void* context) {
+    auto run = current_run;
+    auto address = static_cast<const char*>(info->si_addr);
+    if (run && address >= run->guard_start && address < run->guard_end) {
+        run->reason = "stack overflow onto the guard page";
+        run->address = (address - reinterpret_cast<const char*>(run->words)) / sizeof(unsigned int);
+        siglongjmp(run->jump, 1);
+    }
+
+    // not a guard page, so it's passed on to whatever handled it before. this
+    // handler stays installed for the guard pages of later runs
+    auto& previous = signal == SIGSEGV ? previous_segv_action : previous_bus_action;
+    if (previous.sa_flags & SA_SIGINFO) {
+        previous.sa_sigaction(signal, info, context);
+    } else if (previous.sa_handler == SIG_DFL) {
+        // the process is going down, the same as if nothing had been installed
+        sigaction(signal, &previous, nullptr);
+        raise(signal);
+    } else if (previous.sa_handler != SIG_IGN) {
+        previous.sa_handler(signal);
+    }
+}
+
+GuardedRun::GuardedRun(const Memory& memory) : previous(current_run) {
+    if (memory.guard_end > memory.guard_start) {
+        std::call_once(handler_installed, [] {
+            struct sigaction action{};
+            action.sa_sigaction = on_fault;
+            // not blocked while the handler runs, so jumping out of it needn't restore the signal mask
+            action.sa_flags = SA_SIGINFO | SA_NODEFER;
+            sigemptyset(&action.sa_mask);
+            sigaction(SIGSEGV, &action, &previous_segv_action);
+            // some hosts raise this for protected pages instead
+            sigaction(SIGBUS, &action, &previous_bus_action);
+        });
+
+        words = memory.data();
+        guard_start = reinterpret_cast<const char*>(memory.data() + memory.guard_start);
+        guard_end = reinterpret_cast<const char*>(memory.data() + memory.guard_end);
+    }
+
+    current_run = this;
+}
+
+GuardedRun::~GuardedRun() {
+    current_run = previous;
+}
+
+void GuardedRun::fault(const char* reason, unsigned int address) {
+    auto run = current_run;
+    if (!run) {
+        std::cerr << "vm: " << reason << " at " << address << " outside a run\n";
+        std::abort();
+    }
+
+    run->reason = reason;
+    run->address = address;
+    siglongjmp(run->jump, 1);
+}
+
+#endif
+
+}
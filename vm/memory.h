@@ -0,0 +1,178 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PEBBLE_GUARD_PAGES
+#include <setjmp.h>
+#include <signal.h>
+#endif
+
+namespace pebble {
+
+// the largest memory a VM can have, every 32-bit address is valid
+const unsigned long long max_memory_size = 1ull << 32;
+
+const unsigned long long default_memory_size = 1 << 16;
+
+const unsigned long long default_stack_size = 1 << 14;
+
+// the program's load and store instructions, which may be of a ring a host
+// thread uses at the same time, see ring.h. acquire and release are what
+// x86-64 gives plain moves anyway, so that's all they compile to there
+inline unsigned int load_shared(const unsigned int& word) {
+    return std::atomic_ref<unsigned int>(const_cast<unsigned int&>(word)).load(std::memory_order_acquire);
+}
+
+inline void store_shared(unsigned int& word, unsigned int value) {
+    std::atomic_ref<unsigned int>(word).store(value, std::memory_order_release);
+}
+
+struct MemoryConfig {
+    // in words, up to max_memory_size
+    unsigned long long size = default_memory_size;
+    // asks the host for transparent huge pages, which only pays off for
+    // memory a program touches most of
+    bool huge_pages = false;
+    // in words, the top of memory kept for the stack with a guard page below
+    // it, so a stack overflowing into the rest of memory faults instead.
+    // nothing is guarded if it's 0 or memory is too small to fit it
+    unsigned long long stack_size = default_stack_size;
+};
+
+class MemoryImage;
+
+// guest memory, reserved up front but only backed by host pages as the
+// program touches them, so a large address space costs nothing until it's used
+class Memory {
+    unsigned int* words = nullptr;
+    unsigned long long word_count = 0;
+    // the file of the image the memory was mapped from, if any, see MemoryImage
+    int image_fd = -1;
+    // byte ranges mapped from other files by load, whose pages an image always copies
+    std::vector<std::pair<unsigned long long, unsigned long long>> file_ranges;
+    // the guard page below the stack in words, empty if there's none
+    unsigned long long stack_size = 0;
+    unsigned long long guard_start = 0;
+    unsigned long long guard_end = 0;
+
+    // protects the page below the top stack_size words, if it fits
+    void place_guard(unsigned long long stack_size);
+    void release();
+
+    friend class MemoryImage;
+    friend class GuardedRun;
+
+public:
+    explicit Memory(const MemoryConfig& config = {});
+    // starts out the same as the image and shares its pages until they're written to
+    explicit Memory(const MemoryImage& image);
+    ~Memory();
+
+    Memory(Memory&& other) noexcept;
+    Memory& operator=(Memory&& other) noexcept;
+
+    Memory(const Memory&) = delete;
+    Memory& operator=(const Memory&) = delete;
+
+    // puts count words at address, mapping them from offset in the file fd
+    // where both are page aligned and copying them from words otherwise
+    void load(unsigned int address, const unsigned int* words, unsigned int count, int fd = -1,
+              unsigned long long offset = 0);
+
+    unsigned int& operator[](unsigned int address) {
+        return words[address];
+    }
+
+    const unsigned int& operator[](unsigned int address) const {
+        return words[address];
+    }
+
+    unsigned int* data() {
+        return words;
+    }
+
+    const unsigned int* data() const {
+        return words;
+    }
+
+    // in words
+    unsigned long long size() const {
+        return word_count;
+    }
+
+    // whether the program can read and write the word at address, it can't
+    // past the end of memory or on the stack's guard page
+    bool accessible(unsigned long long address) const {
+        return address < word_count && (address < guard_start || address >= guard_end);
+    }
+
+    bool accessible(unsigned long long address, unsigned long long count) const {
+        auto end = address + count;
+        return end <= word_count && (end <= guard_start || address >= guard_end);
+    }
+};
+
+#ifdef PEBBLE_GUARD_PAGES
+// while one is alive, a fault on the guard page of its memory jumps back to
+// where jump was set instead of killing the process, and so does fault. see VM::run, the jump
+// has to be set in the frame that runs the program
+//
+// nothing that has to be destroyed can be on the stack between there and the
+// fault, and whatever the program was doing is left unfinished
+class GuardedRun {
+    const char* guard_start = nullptr;
+    const char* guard_end = nullptr;
+    const unsigned int* words = nullptr;
+    // the one this replaced on its thread
+    GuardedRun* previous;
+
+    static void on_fault(int signal, siginfo_t* info, void* context);
+
+public:
+    sigjmp_buf jump;
+    // why and where the program faulted
+    const char* reason = nullptr;
+    unsigned int address = 0;
+
+    explicit GuardedRun(const Memory& memory);
+    ~GuardedRun();
+
+    GuardedRun(const GuardedRun&) = delete;
+    GuardedRun& operator=(const GuardedRun&) = delete;
+
+    // jumps back out of the thread's run the same as a fault on the guard
+    // page, for faults the VM finds itself
+    [[noreturn]] static void fault(const char* reason, unsigned int address);
+};
+#endif
+
+// a read-only copy of a Memory, which can be mapped into any number of
+// others at the cost of a page table per mapping
+class MemoryImage {
+#ifdef __linux__
+    // an in-memory file holding the pages that were resident when the copy was made
+    int fd = -1;
+    unsigned long long word_count = 0;
+    unsigned long long stack_size = 0;
+#else
+    Memory words;
+#endif
+
+    friend class Memory;
+
+public:
+    explicit MemoryImage(const Memory& memory);
+    ~MemoryImage();
+
+    MemoryImage(const MemoryImage&) = delete;
+    MemoryImage& operator=(const MemoryImage&) = delete;
+
+    // in words
+    unsigned long long size() const;
+};
+
+}
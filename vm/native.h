@@ -0,0 +1,14 @@
+#pragma once
+
+#include <functional>
+
+namespace pebble {
+
+class NativeCall;
+
+// a host function a program calls with native <index>, see VM::register_native.
+// it takes its arguments from a, b and the stack and leaves its results in a
+// and b, see NativeCall
+using NativeFunction = std::function<void(NativeCall& call)>;
+
+}
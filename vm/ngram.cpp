@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <tuple>
+
+#include "ngram.h"
+#include "vm.h"
+
+namespace pebble {
+
+void NgramProfile::write(std::ostream& out) const {
+    std::vector<std::tuple<unsigned long long, Handler, Handler>> pairs;
+
+    for (unsigned int first = 0; first < num_handlers; first++) {
+        for (unsigned int second = 0; second < num_handlers; second++) {
+            auto count = counts[first * num_handlers + second];
+            if (count) {
+                pairs.emplace_back(count, static_cast<Handler>(first), static_cast<Handler>(second));
+            }
+        }
+    }
+
+    std::sort(pairs.begin(), pairs.end(), [](auto& l, auto& r) {
+        return std::get<0>(l) > std::get<0>(r);
+    });
+
+    for (auto& [count, first, second] : pairs) {
+        out << handler_name(first) << " " << handler_name(second) << " " << count << "\n";
+    }
+
+    std::vector<std::pair<unsigned long long, std::tuple<Handler, Handler, Handler>>> triples;
+    for (auto& [triple, count] : triple_counts) {
+        triples.emplace_back(count, triple);
+    }
+
+    std::stable_sort(triples.begin(), triples.end(), [](auto& l, auto& r) {
+        return l.first > r.first;
+    });
+
+    for (auto& [count, triple] : triples) {
+        auto& [first, second, third] = triple;
+        out << handler_name(first) << " " << handler_name(second) << " " << handler_name(third) << " " << count << "\n";
+    }
+}
+
+void VM::run_profiled(NgramProfile& profile) {
+#ifdef PEBBLE_GUARD_PAGES
+    // the same as in run
+    GuardedRun guarded(memory);
+    if (sigsetjmp(guarded.jump, 0)) {
+        std::cerr << "vm: " << guarded.reason << " at " << guarded.address << "\n";
+        dump_trace(std::cerr);
+        return;
+    }
+#endif
+
+    // how many of the handlers before this one ran back to back up to it, 0 to 2
+    unsigned int run_length = 0;
+    Handler previous = Handler::OutOfCode;
+    Handler before_previous = Handler::OutOfCode;
+    unsigned int expected_ip;
+
+    unsigned int r[NumRegisters];
+    std::copy(registers, registers + NumRegisters, r);
+    auto& ip = r[RegisterIP];
+
+    while (true) {
+        if (!verification.verified) {
+            if (auto reason = check(r)) {
+                report_fault(reason, r);
+                break;
+            }
+        }
+
+        auto handler = ip < code_size ? decode(memory.data(), ip, code_size).handler : Handler::OutOfCode;
+
+        if (run_length && ip != expected_ip) {
+            run_length = 0;
+        }
+
+        if (run_length >= 1) {
+            profile.add(previous, handler);
+        }
+        if (run_length >= 2) {
+            profile.add(before_previous, previous, handler);
+        }
+
+        if (Instruction::opcode(memory[ip]) == Opcode::Halt) {
+            break;
+        }
+
+        run_length = std::min(run_length + 1, 2u);
+        before_previous = previous;
+        previous = handler;
+        expected_ip = ip + std::max(instruction_width(memory[ip]), 1u);
+
+        trace_instruction(ip, r);
+        execute(memory[ip], r);
+    }
+
+    std::copy(r, r + NumRegisters, registers);
+}
+
+}
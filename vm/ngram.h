@@ -0,0 +1,36 @@
+#pragma once
+
+#include <map>
+#include <ostream>
+#include <tuple>
+#include <vector>
+
+#include "decoder.h"
+
+namespace pebble {
+
+// counts how often each pair and each triple of handlers ran back to back
+// without a jump in between, which is what pebble_superinstructions picks
+// superinstructions from
+class NgramProfile {
+    static const unsigned int num_handlers = static_cast<unsigned int>(Handler::NumHandlers);
+
+    std::vector<unsigned long long> counts = std::vector<unsigned long long>(num_handlers * num_handlers);
+    // sparse, most of the num_handlers^3 triples never run
+    std::map<std::tuple<Handler, Handler, Handler>, unsigned long long> triple_counts;
+
+public:
+    void add(Handler first, Handler second) {
+        counts[static_cast<unsigned int>(first) * num_handlers + static_cast<unsigned int>(second)]++;
+    }
+
+    void add(Handler first, Handler second, Handler third) {
+        triple_counts[{first, second, third}]++;
+    }
+
+    // one "first second count" line per pair, most frequent first, then one
+    // "first second third count" line per triple, most frequent first
+    void write(std::ostream& out) const;
+};
+
+}
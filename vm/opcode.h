@@ -36,7 +36,22 @@ enum Opcode {
     Push,
     Pop,
     Call,
-    Return
+    Return,
+    // host
+    Native,
+    // vectors
+    VectorAdd,
+    VectorSubtract,
+    VectorMultiply,
+    VectorMinimum,
+    VectorMaximum,
+    VectorSum,
+    VectorDot,
+    // blocks
+    Copy,
+    Fill,
+    Compare,
+    NumOpcodes
 };
 
 enum {
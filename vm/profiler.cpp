@@ -0,0 +1,112 @@
+#include <algorithm>
+
+#include "profiler.h"
+
+namespace pebble {
+
+namespace {
+
+// deeper stacks are cut off at the outermost end
+const unsigned int max_stack_depth = 256;
+
+}
+
+void Profiler::add_symbols(const std::unordered_map<std::string, unsigned int>& labels) {
+    for (auto& [name, address] : labels) {
+        // start is where the assembler begins the program, so it's treated as a function
+        if (name == "start") {
+            symbols[address] = name;
+        } else {
+            symbols.emplace(address, name);
+        }
+    }
+}
+
+void Profiler::find_functions(const VM& vm) {
+    function_starts = {0};
+
+    for (auto& [address, name] : symbols) {
+        if (name == "start") {
+            function_starts.push_back(address);
+        }
+    }
+
+    for (unsigned int address = 0; address < vm.code_size; address += std::max(instruction_width(vm.memory[address]), 1u)) {
+        auto word = vm.memory[address];
+        if (Instruction::opcode(word) == Opcode::Call && Instruction::has_immediate(word) && address + 1 < vm.code_size) {
+            function_starts.push_back(vm.memory[address + 1]);
+        }
+    }
+
+    std::sort(function_starts.begin(), function_starts.end());
+    function_starts.erase(std::unique(function_starts.begin(), function_starts.end()), function_starts.end());
+}
+
+unsigned int Profiler::function_containing(unsigned int address) const {
+    return *--std::upper_bound(function_starts.begin(), function_starts.end(), address);
+}
+
+// frames start with push fp, mov fp, sp, which leaves the caller's fp at
+// fp + 1 and the return address at fp + 2. the sampler runs outside the
+// VM's GuardedRun, so the walk stops at anything it can't read, the guard
+// page included
+void Profiler::sample(const VM& vm) {
+    auto& r = vm.registers;
+    auto& memory = vm.memory;
+
+    // innermost first
+    std::vector<unsigned int> frames{function_containing(r[RegisterIP])};
+
+    // on the first instruction of a function its frame isn't set up yet and
+    // the return address is still on top of the stack
+    if (std::binary_search(function_starts.begin(), function_starts.end(), r[RegisterIP]) &&
+        memory.accessible(r[RegisterSP] + 1ull)) {
+        auto return_address = memory[r[RegisterSP] + 1];
+        if (return_address > 0 && return_address <= vm.code_size) {
+            frames.push_back(function_containing(return_address - 1));
+        }
+    }
+
+    auto fp = r[RegisterFP];
+    while (frames.size() < max_stack_depth && memory.accessible(fp + 1ull, 2)) {
+        auto caller_fp = memory[fp + 1];
+        auto return_address = memory[fp + 2];
+        if (caller_fp <= fp || return_address == 0 || return_address > vm.code_size) {
+            break;
+        }
+
+        frames.push_back(function_containing(return_address - 1));
+        fp = caller_fp;
+    }
+
+    std::reverse(frames.begin(), frames.end());
+    stacks[frames]++;
+}
+
+void Profiler::run(VM& vm) {
+    find_functions(vm);
+
+    while (vm.run(interval) == RunStatus::OutOfFuel) {
+        sample(vm);
+    }
+}
+
+void Profiler::write(std::ostream& out) const {
+    for (auto& [frames, count] : stacks) {
+        for (size_t i = 0; i < frames.size(); i++) {
+            if (i > 0) {
+                out << ";";
+            }
+
+            auto symbol = symbols.find(frames[i]);
+            if (symbol != symbols.end()) {
+                out << symbol->second;
+            } else {
+                out << "0x" << std::hex << frames[i] << std::dec;
+            }
+        }
+        out << " " << count << "\n";
+    }
+}
+
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "vm.h"
+
+namespace pebble {
+
+// prime so samples don't keep landing on the same iteration of a loop
+const unsigned long long default_sample_interval = 9973;
+
+// samples where a program is and the calls that led there, for flame graphs
+//
+// the VM is run with a budget of interval and sampled each time it runs out,
+// so the engines don't know about profiling and it costs nothing when it
+// isn't used. budgets run out at the end of a block, so samples land on the
+// first instruction of one
+class Profiler {
+    unsigned long long interval;
+    std::unordered_map<unsigned int, std::string> symbols;
+
+    // where each function starts, the targets of the calls in the program
+    std::vector<unsigned int> function_starts;
+    // function starts from the outermost call in, and how often they were sampled
+    std::map<std::vector<unsigned int>, unsigned long long> stacks;
+
+    void find_functions(const VM& vm);
+    unsigned int function_containing(unsigned int address) const;
+    void sample(const VM& vm);
+
+public:
+    explicit Profiler(unsigned long long interval = default_sample_interval) : interval(interval) {}
+
+    // names functions by the labels at their first instruction, see Assembler::label_addresses
+    void add_symbols(const std::unordered_map<std::string, unsigned int>& labels);
+
+    // runs the VM until it halts, sampling it every interval instructions
+    void run(VM& vm);
+
+    // one "outer;inner;innermost count" line per stack, the collapsed format
+    // flamegraph.pl and speedscope read
+    void write(std::ostream& out) const;
+};
+
+}
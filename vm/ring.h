@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+
+namespace pebble {
+
+// a single producer, single consumer queue of words in guest memory, which
+// the host and the program use at the same time without copying anything in
+// or out or calling each other. see VM::map_ring
+//
+// the program uses it with plain loads and stores at
+//   address + ring_capacity_offset  how many slots there are, a power of two
+//   address + ring_head_offset      how many words the consumer has taken
+//   address + ring_tail_offset      how many words the producer has added
+//   address + ring_header_size      the slots, word n is in slot n & (capacity - 1)
+//
+// the counters only ever go up, wrapping around, so the ring is empty when
+// they're equal and full when they're capacity apart. each side only writes
+// its own counter, after the slots it covers. the program's loads and stores
+// are acquire and release accesses in every engine, see load_shared, and the
+// JIT's plain moves are the same on x86-64, the only host it's built for
+const unsigned int ring_capacity_offset = 0;
+// the counters are on cache lines of their own so the two sides don't share one
+const unsigned int ring_head_offset = 16;
+const unsigned int ring_tail_offset = 32;
+const unsigned int ring_header_size = 48;
+
+// the host's end of a ring, it either produces into it or consumes from it.
+// only valid while the VM it came from keeps its memory
+class Ring {
+    unsigned int* header = nullptr;
+    unsigned int* slots = nullptr;
+    unsigned int mask = 0;
+
+    std::atomic_ref<unsigned int> counter(unsigned int offset) const {
+        return std::atomic_ref<unsigned int>(header[offset]);
+    }
+
+public:
+    Ring() = default;
+    Ring(unsigned int* header, unsigned int capacity)
+            : header(header), slots(header + ring_header_size), mask(capacity - 1) {}
+
+    unsigned int capacity() const {
+        return mask + 1;
+    }
+
+    // as the producer, copies as many of count values as there's room for,
+    // returning how many
+    size_t push(const unsigned int* values, size_t count) {
+        auto tail = counter(ring_tail_offset).load(std::memory_order_relaxed);
+        auto head = counter(ring_head_offset).load(std::memory_order_acquire);
+        auto n = std::min<size_t>(count, capacity() - (tail - head));
+
+        for (size_t i = 0; i < n; i++) {
+            slots[(tail + i) & mask] = values[i];
+        }
+        counter(ring_tail_offset).store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    bool push(unsigned int value) {
+        return push(&value, 1) == 1;
+    }
+
+    // as the consumer, takes up to count values, returning how many there were
+    size_t pop(unsigned int* values, size_t count) {
+        auto head = counter(ring_head_offset).load(std::memory_order_relaxed);
+        auto tail = counter(ring_tail_offset).load(std::memory_order_acquire);
+        auto n = std::min<size_t>(count, tail - head);
+
+        for (size_t i = 0; i < n; i++) {
+            values[i] = slots[(head + i) & mask];
+        }
+        counter(ring_head_offset).store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    bool pop(unsigned int& value) {
+        return pop(&value, 1) == 1;
+    }
+
+    // how many words are waiting to be consumed
+    unsigned int size() const {
+        return counter(ring_tail_offset).load(std::memory_order_acquire) -
+               counter(ring_head_offset).load(std::memory_order_acquire);
+    }
+};
+
+}
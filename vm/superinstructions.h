@@ -0,0 +1,14 @@
+#pragma once
+
+// the default set of superinstructions, used unless the build is configured
+// with PEBBLE_SUPERINSTRUCTION_PROFILE, in which case pebble_superinstructions
+// generates this list from the profile instead
+//
+// each entry fuses a sequential handler with the handler that follows it
+#define SUPERINSTRUCTIONS(X) \
+    X(EqualToImmediate, JumpIfZero) \
+    X(EqualToImmediate, JumpIfNonZero) \
+    X(EqualToRegister, JumpIfZero) \
+    X(PushRegister, Call) \
+    X(PushImmediate, Call) \
+    X(Pop, Return)
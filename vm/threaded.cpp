@@ -0,0 +1,296 @@
+#include <algorithm>
+#include <cassert>
+
+#include "vm.h"
+
+namespace pebble {
+
+template<>
+inline void VM::step<Handler::LoadAddress>(const DecodedInstruction* i, unsigned int& pc, unsigned int* r) {
+    r[i->reg] = load_shared(memory[i->operand]);
+    pc += i->width;
+}
+
+template<>
+inline void VM::step<Handler::LoadFramePointerOffset>(const DecodedInstruction* i, unsigned int& pc, unsigned int* r) {
+    int address = r[RegisterFP] + unsigned_to_signed(i->operand);
+    r[i->reg] = load_shared(memory[address]);
+    pc += i->width;
+}
+
+// pc moves on before the write, which may invalidate the record being run
+template<>
+inline void VM::step<Handler::StoreAddress>(const DecodedInstruction* i, unsigned int& pc, unsigned int* r) {
+    auto address = i->operand;
+    auto value = r[i->reg];
+    pc += i->width;
+    write(address, value);
+}
+
+template<>
+inline void VM::step<Handler::StoreFramePointerOffset>(const DecodedInstruction* i, unsigned int& pc, unsigned int* r) {
+    int address = r[RegisterFP] + unsigned_to_signed(i->operand);
+    auto value = r[i->reg];
+    pc += i->width;
+    write(address, value);
+}
+
+template<>
+inline void VM::step<Handler::MoveRegister>(const DecodedInstruction* i, unsigned int& pc, unsigned int* r) {
+    r[i->reg] = r[i->operand];
+    pc += i->width;
+}
+
+template<>
+inline void VM::step<Handler::MoveImmediate>(const DecodedInstruction* i, unsigned int& pc, unsigned int* r) {
+    r[i->reg] = i->operand;
+    pc += i->width;
+}
+
+#define ARITHMETIC_LOGIC_OPERATION_STEPS(NAME, OPERATOR) \
+template<> \
+inline void VM::step<Handler::NAME##Register>(const DecodedInstruction* i, unsigned int& pc, unsigned int* r) { \
+    arithmetic_logic<Operation::NAME, false>(r, i->reg, i->operand, pc); \
+    pc += i->width; \
+} \
+template<> \
+inline void VM::step<Handler::NAME##Immediate>(const DecodedInstruction* i, unsigned int& pc, unsigned int* r) { \
+    arithmetic_logic<Operation::NAME, true>(r, i->reg, i->operand, pc); \
+    pc += i->width; \
+}
+
+ARITHMETIC_LOGIC_OPERATIONS(ARITHMETIC_LOGIC_OPERATION_STEPS)
+
+template<>
+inline void VM::step<Handler::NotRegister>(const DecodedInstruction* i, unsigned int& pc, unsigned int* r) {
+    r[i->reg] = ~r[i->reg];
+    pc += i->width;
+}
+
+template<>
+inline void VM::step<Handler::NotImmediate>(const DecodedInstruction* i, unsigned int& pc, unsigned int* r) {
+    r[i->reg] = ~i->operand;
+    pc += i->width;
+}
+
+template<>
+inline void VM::step<Handler::PushRegister>(const DecodedInstruction* i, unsigned int& pc, unsigned int* r) {
+    auto value = r[i->reg];
+    pc += i->width;
+    push(value, r);
+}
+
+template<>
+inline void VM::step<Handler::PushImmediate>(const DecodedInstruction* i, unsigned int& pc, unsigned int* r) {
+    auto value = i->operand;
+    pc += i->width;
+    push(value, r);
+}
+
+template<>
+inline void VM::step<Handler::Pop>(const DecodedInstruction* i, unsigned int& pc, unsigned int* r) {
+    r[i->reg] = pop(r);
+    pc += i->width;
+}
+
+// pc moves on before the call, which may write into the code the same as a store
+template<>
+inline void VM::step<Handler::Native>(const DecodedInstruction* i, unsigned int& pc, unsigned int* r) {
+    auto index = i->operand;
+    pc += i->width;
+    NativeCall call(*this, r);
+    natives[index](call);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PEBBLE_COMPUTED_GOTO
+#endif
+
+// with computed goto every handler ends in its own indirect jump to the next
+// handler instead of returning to a shared switch, which gives the branch
+// predictor one site per handler to learn from
+//
+// handlers are labels in both modes so superinstructions can jump straight
+// into the handler of their second half
+#ifdef PEBBLE_COMPUTED_GOTO
+#define UNTRACED_HANDLER(NAME) op_##NAME:
+#define DISPATCH() goto *dispatch_table[static_cast<unsigned short>(i->handler)]
+#else
+#define UNTRACED_HANDLER(NAME) case Handler::NAME: op_##NAME:
+#define DISPATCH() continue
+#endif
+
+// every handler but Undecoded runs an instruction, including the second half
+// of a superinstruction which jumps to its label
+#define HANDLER(NAME) \
+UNTRACED_HANDLER(NAME) \
+    trace_instruction(pc, r);
+
+// sequential instructions are decoded so they never run past the sentinel,
+// anything that sets pc to an arbitrary address is clamped to it
+#define NEXT() \
+    i = &code[pc]; \
+    DISPATCH()
+
+#define NEXT_CHECKED() \
+    i = &code[pc < code_size ? pc : code_size]; \
+    DISPATCH()
+
+// a block runs from block_start to the jump, call or return ending it, which
+// is where its words are charged and the budget is checked
+#define CHARGE_BLOCK() \
+    fuel -= pc + i->width - block_start
+
+// also where a program that wrote into its code is left to run_checked, see
+// VM::run. a write leaves the records it touches undecoded, so nothing it
+// wrote runs before then
+#define LEAVE() \
+    r[RegisterIP] = pc; \
+    std::copy(r, r + NumRegisters, registers); \
+    return RunStatus::OutOfFuel
+
+#define NEXT_BLOCK() \
+    block_start = pc; \
+    if (fuel <= 0 || !verification.verified) { \
+        LEAVE(); \
+    } \
+    NEXT_CHECKED()
+
+#define SEQUENTIAL_HANDLER(NAME) \
+HANDLER(NAME) { \
+    step<Handler::NAME>(i, pc, r); \
+    NEXT(); \
+}
+
+// the second half runs from its own record, which is kept decoded alongside.
+// the first half may have written over it, which leaves the record undecoded,
+// so it's dispatched as usual then instead of running what was there before
+#define SUPERINSTRUCTION_HANDLER(FIRST, SECOND) \
+HANDLER(FIRST##_##SECOND) { \
+    step<Handler::FIRST>(i, pc, r); \
+    i = &code[pc]; \
+    if (i->handler == Handler::Undecoded) { \
+        DISPATCH(); \
+    } \
+    goto op_##SECOND; \
+}
+
+#define HANDLER_LABEL(NAME) &&op_##NAME,
+#define SUPERINSTRUCTION_LABEL(FIRST, SECOND) &&op_##FIRST##_##SECOND,
+
+RunStatus VM::run_threaded(long long& fuel) {
+#ifdef PEBBLE_COMPUTED_GOTO
+    // must stay in the same order as Handler
+    static void* dispatch_table[] = {
+            SEQUENTIAL_HANDLERS(HANDLER_LABEL)
+            CONTROL_HANDLERS(HANDLER_LABEL)
+            SUPERINSTRUCTIONS(SUPERINSTRUCTION_LABEL)
+            SPECIAL_HANDLERS(HANDLER_LABEL)
+    };
+
+    static_assert(sizeof(dispatch_table) / sizeof(dispatch_table[0]) ==
+                  static_cast<unsigned short>(Handler::NumHandlers));
+#endif
+
+    auto code = decoded.data();
+    unsigned int r[NumRegisters];
+    std::copy(registers, registers + NumRegisters, r);
+    // r[RegisterIP] is only kept up to date around VM::execute
+    unsigned int pc = r[RegisterIP];
+    unsigned int block_start = pc;
+    const DecodedInstruction* i;
+
+#ifdef PEBBLE_COMPUTED_GOTO
+    NEXT_CHECKED();
+#else
+    i = &code[pc < code_size ? pc : code_size];
+    for (;;) {
+        switch (i->handler) {
+#endif
+
+    SEQUENTIAL_HANDLERS(SEQUENTIAL_HANDLER)
+
+    HANDLER(Halt) {
+        r[RegisterIP] = pc;
+        std::copy(r, r + NumRegisters, registers);
+        return RunStatus::Halted;
+    }
+
+    HANDLER(Jump) {
+        CHARGE_BLOCK();
+        pc = i->operand;
+        NEXT_BLOCK();
+    }
+
+    HANDLER(JumpIfZero) {
+        CHARGE_BLOCK();
+        pc = r[RegisterA] == 0 ? i->operand : pc + i->width;
+        NEXT_BLOCK();
+    }
+
+    HANDLER(JumpIfNonZero) {
+        CHARGE_BLOCK();
+        pc = r[RegisterA] != 0 ? i->operand : pc + i->width;
+        NEXT_BLOCK();
+    }
+
+    HANDLER(Call) {
+        CHARGE_BLOCK();
+        auto address = i->operand;
+        push(pc + i->width, r);
+        pc = address;
+        NEXT_BLOCK();
+    }
+
+    HANDLER(Return) {
+        CHARGE_BLOCK();
+        pc = pop(r);
+        NEXT_BLOCK();
+    }
+
+    SUPERINSTRUCTIONS(SUPERINSTRUCTION_HANDLER)
+
+    // the instruction may jump anywhere, so it ends the block
+    HANDLER(Generic) {
+        CHARGE_BLOCK();
+        r[RegisterIP] = pc;
+        execute(memory[pc], r);
+        pc = r[RegisterIP];
+        NEXT_BLOCK();
+    }
+
+    UNTRACED_HANDLER(Undecoded) {
+        if (!verification.verified) {
+            fuel -= pc - block_start;
+            LEAVE();
+        }
+        decode_record(pc);
+        NEXT();
+    }
+
+    // pc is the real address here, the record is only the sentinel
+    HANDLER(OutOfCode) {
+        if (!verification.verified) {
+            fuel -= pc - block_start;
+            LEAVE();
+        }
+        r[RegisterIP] = pc;
+        if (Instruction::opcode(memory[pc]) == Opcode::Halt) {
+            std::copy(r, r + NumRegisters, registers);
+            return RunStatus::Halted;
+        }
+        fuel -= pc + Instruction::width(memory[pc]) - block_start;
+        execute(memory[pc], r);
+        pc = r[RegisterIP];
+        NEXT_BLOCK();
+    }
+
+#ifndef PEBBLE_COMPUTED_GOTO
+            default:
+                assert(false);
+        }
+    }
+#endif
+}
+
+}
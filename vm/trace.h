@@ -0,0 +1,59 @@
+#pragma once
+
+#include <ostream>
+
+#include "instruction.h"
+
+// how many of the last instructions run each VM keeps, a power of two, or 0
+// for no trace at all
+#ifndef PEBBLE_TRACE_SIZE
+#define PEBBLE_TRACE_SIZE 0
+#endif
+
+namespace pebble {
+
+const unsigned int trace_size = PEBBLE_TRACE_SIZE;
+
+struct TraceEntry {
+    unsigned int ip;
+    unsigned int instruction;
+    unsigned int a;
+    unsigned int b;
+    unsigned int sp;
+};
+
+// a ring buffer of the last Size instructions run, which recording into only
+// costs a store. with a Size of 0 it records nothing and takes no space
+template<unsigned int Size>
+class Trace {
+    static_assert((Size & (Size - 1)) == 0, "the trace size must be a power of two");
+
+    TraceEntry entries[Size] = {};
+    unsigned long long count = 0;
+
+public:
+    void record(unsigned int ip, unsigned int instruction, unsigned int a, unsigned int b, unsigned int sp) {
+        entries[count++ & (Size - 1)] = TraceEntry{ip, instruction, a, b, sp};
+    }
+
+    // oldest first
+    void write(std::ostream& out) const {
+        auto first = count < Size ? 0 : count - Size;
+        for (auto i = first; i < count; i++) {
+            auto& entry = entries[i & (Size - 1)];
+            out << "ip " << entry.ip << " opcode " << Instruction::opcode(entry.instruction)
+                << " instruction 0x" << std::hex << entry.instruction << std::dec
+                << " a " << entry.a << " b " << entry.b << " sp " << entry.sp << "\n";
+        }
+    }
+};
+
+template<>
+class Trace<0> {
+public:
+    void record(unsigned int, unsigned int, unsigned int, unsigned int, unsigned int) {}
+
+    void write(std::ostream&) const {}
+};
+
+}
@@ -0,0 +1,198 @@
+#include <algorithm>
+
+#include "vector.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define PEBBLE_VECTOR_AVX2
+#include <immintrin.h>
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+namespace pebble {
+
+namespace {
+
+struct Add {
+    static unsigned int apply(unsigned int l, unsigned int r) {
+        return l + r;
+    }
+#ifdef PEBBLE_VECTOR_AVX2
+    AVX2_TARGET static __m256i apply(__m256i l, __m256i r) {
+        return _mm256_add_epi32(l, r);
+    }
+#endif
+};
+
+struct Subtract {
+    static unsigned int apply(unsigned int l, unsigned int r) {
+        return l - r;
+    }
+#ifdef PEBBLE_VECTOR_AVX2
+    AVX2_TARGET static __m256i apply(__m256i l, __m256i r) {
+        return _mm256_sub_epi32(l, r);
+    }
+#endif
+};
+
+struct Multiply {
+    static unsigned int apply(unsigned int l, unsigned int r) {
+        return l * r;
+    }
+#ifdef PEBBLE_VECTOR_AVX2
+    AVX2_TARGET static __m256i apply(__m256i l, __m256i r) {
+        return _mm256_mullo_epi32(l, r);
+    }
+#endif
+};
+
+struct Minimum {
+    static unsigned int apply(unsigned int l, unsigned int r) {
+        return std::min(l, r);
+    }
+#ifdef PEBBLE_VECTOR_AVX2
+    AVX2_TARGET static __m256i apply(__m256i l, __m256i r) {
+        return _mm256_min_epu32(l, r);
+    }
+#endif
+};
+
+struct Maximum {
+    static unsigned int apply(unsigned int l, unsigned int r) {
+        return std::max(l, r);
+    }
+#ifdef PEBBLE_VECTOR_AVX2
+    AVX2_TARGET static __m256i apply(__m256i l, __m256i r) {
+        return _mm256_max_epu32(l, r);
+    }
+#endif
+};
+
+template<typename Operation>
+void combine(unsigned int* x, const unsigned int* y, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        x[i] = Operation::apply(x[i], y[i]);
+    }
+}
+
+bool overlaps(const unsigned int* x, const unsigned int* y, size_t count) {
+    return x != y && x < y + count && y < x + count;
+}
+
+#ifdef PEBBLE_VECTOR_AVX2
+
+// words per register
+const size_t lanes = 8;
+
+bool has_avx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+__m256i AVX2_TARGET load(const unsigned int* words) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words));
+}
+
+unsigned int AVX2_TARGET horizontal_sum(__m256i v) {
+    auto sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+    return _mm_cvtsi128_si32(sum);
+}
+
+template<typename Operation>
+AVX2_TARGET void combine_avx2(unsigned int* x, const unsigned int* y, size_t count) {
+    size_t i = 0;
+    for (; i + lanes <= count; i += lanes) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(x + i), Operation::apply(load(x + i), load(y + i)));
+    }
+    for (; i < count; i++) {
+        x[i] = Operation::apply(x[i], y[i]);
+    }
+}
+
+AVX2_TARGET unsigned int sum_avx2(const unsigned int* x, size_t count) {
+    auto sums = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + lanes <= count; i += lanes) {
+        sums = _mm256_add_epi32(sums, load(x + i));
+    }
+
+    auto sum = horizontal_sum(sums);
+    for (; i < count; i++) {
+        sum += x[i];
+    }
+    return sum;
+}
+
+AVX2_TARGET unsigned int dot_avx2(const unsigned int* x, const unsigned int* y, size_t count) {
+    auto sums = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + lanes <= count; i += lanes) {
+        sums = _mm256_add_epi32(sums, _mm256_mullo_epi32(load(x + i), load(y + i)));
+    }
+
+    auto sum = horizontal_sum(sums);
+    for (; i < count; i++) {
+        sum += x[i] * y[i];
+    }
+    return sum;
+}
+
+#endif
+
+template<typename Operation>
+void dispatch(unsigned int* x, const unsigned int* y, size_t count) {
+#ifdef PEBBLE_VECTOR_AVX2
+    if (has_avx2() && !overlaps(x, y, count)) {
+        combine_avx2<Operation>(x, y, count);
+        return;
+    }
+#endif
+    combine<Operation>(x, y, count);
+}
+
+}
+
+#define VECTOR_OPERATION_CASE(NAME) \
+case VectorOperation::NAME: \
+    dispatch<NAME>(x, y, count); \
+    break;
+
+void vector_combine(VectorOperation operation, unsigned int* x, const unsigned int* y, size_t count) {
+    switch (operation) {
+        VECTOR_OPERATIONS(VECTOR_OPERATION_CASE)
+    }
+}
+
+#undef VECTOR_OPERATION_CASE
+
+// the sums wrap, so adding in any order gives the same result
+unsigned int vector_sum(const unsigned int* x, size_t count) {
+#ifdef PEBBLE_VECTOR_AVX2
+    if (has_avx2()) {
+        return sum_avx2(x, count);
+    }
+#endif
+
+    unsigned int sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += x[i];
+    }
+    return sum;
+}
+
+unsigned int vector_dot(const unsigned int* x, const unsigned int* y, size_t count) {
+#ifdef PEBBLE_VECTOR_AVX2
+    if (has_avx2()) {
+        return dot_avx2(x, y, count);
+    }
+#endif
+
+    unsigned int sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += x[i] * y[i];
+    }
+    return sum;
+}
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+
+namespace pebble {
+
+// the vector instructions that combine two runs of words into the first
+#define VECTOR_OPERATIONS(X) \
+    X(Add) \
+    X(Subtract) \
+    X(Multiply) \
+    X(Minimum) \
+    X(Maximum)
+
+#define VECTOR_OPERATION_ENUM_ENTRY(NAME) NAME,
+
+enum class VectorOperation {
+    VECTOR_OPERATIONS(VECTOR_OPERATION_ENUM_ENTRY)
+};
+
+#undef VECTOR_OPERATION_ENUM_ENTRY
+
+// the kernels behind the vector instructions, on whole words that wrap around
+// like the scalar instructions do, with minimum and maximum unsigned. they use
+// AVX2 where the host has it and plain loops otherwise, which the compiler is
+// free to vectorise
+//
+// x and y may be the same run, runs that partly overlap are worked through
+// one word at a time from the start, as the scalar instructions would
+void vector_combine(VectorOperation operation, unsigned int* x, const unsigned int* y, size_t count);
+unsigned int vector_sum(const unsigned int* x, size_t count);
+unsigned int vector_dot(const unsigned int* x, const unsigned int* y, size_t count);
+
+}
@@ -0,0 +1,122 @@
+#include "verifier.h"
+#include "vm.h"
+
+namespace pebble {
+
+namespace {
+
+const unsigned int known_bits = Instruction::opcode_mask |
+                                Instruction::register_mask << Instruction::destination_shift |
+                                Instruction::register_mask << Instruction::source_shift |
+                                Instruction::immediate_flag |
+                                Instruction::frame_pointer_offset_flag;
+
+bool is_transfer(unsigned int opcode) {
+    return opcode == Opcode::Jump || opcode == Opcode::JumpIfZero || opcode == Opcode::JumpIfNonZero ||
+           opcode == Opcode::Call;
+}
+
+// whether running off the end of the instruction carries on into the next word
+bool falls_through(unsigned int opcode) {
+    return opcode != Opcode::Jump && opcode != Opcode::Return && opcode != Opcode::Halt;
+}
+
+Verification fail(unsigned int address, const char* reason) {
+    return Verification{.verified = false, .address = address, .reason = reason};
+}
+
+}
+
+const char* check_encoding(unsigned int word) {
+    auto opcode = Instruction::opcode(word);
+
+    if (word & ~known_bits) {
+        return "unknown flags";
+    }
+    if (opcode >= Opcode::NumOpcodes) {
+        return "unknown opcode";
+    }
+    if (Instruction::destination(word) >= NumRegisters || Instruction::source(word) >= NumRegisters) {
+        return "unknown register";
+    }
+
+    if ((opcode == Opcode::Load || opcode == Opcode::Store) && !Instruction::has_immediate(word)) {
+        return "load or store without an address";
+    }
+    if (is_transfer(opcode) && !Instruction::has_immediate(word)) {
+        return "jump or call without an address";
+    }
+    if (opcode == Opcode::Native && !Instruction::has_immediate(word)) {
+        return "native call without an index";
+    }
+    if (opcode != Opcode::Load && opcode != Opcode::Store &&
+        Instruction::addressing_mode(word) == Opcode::AddressingModeFramePointerOffset) {
+        return "frame pointer offset on an instruction that doesn't access memory";
+    }
+
+    return nullptr;
+}
+
+Verification verify(const Memory& memory, unsigned int code_size, const std::vector<NativeFunction>& natives) {
+    // whether an instruction starts at each address, the end included
+    std::vector<bool> starts(code_size + 1);
+    starts[code_size] = true;
+
+    for (unsigned int address = 0; address < code_size; address += Instruction::width(memory[address])) {
+        auto word = memory[address];
+        if (auto reason = check_encoding(word)) {
+            return fail(address, reason);
+        }
+        if (address + Instruction::width(word) > code_size) {
+            return fail(address, "immediate past the end of the code");
+        }
+        starts[address] = true;
+    }
+
+    auto reaches_end = code_size == 0;
+    for (unsigned int address = 0; address < code_size; address += Instruction::width(memory[address])) {
+        auto word = memory[address];
+        auto opcode = Instruction::opcode(word);
+        auto immediate = Instruction::has_immediate(word) ? memory[address + 1] : 0;
+
+        if (is_transfer(opcode)) {
+            if (immediate > code_size) {
+                return fail(address, "jump or call outside the code");
+            }
+            if (!starts[immediate]) {
+                return fail(address, "jump or call into the middle of an instruction");
+            }
+            reaches_end |= immediate == code_size;
+        }
+
+        if (Instruction::has_address(word) && !is_transfer(opcode)) {
+            if (!memory.accessible(immediate)) {
+                return fail(address, "address outside memory or on the stack guard page");
+            }
+            if (opcode == Opcode::Store && immediate <= code_size) {
+                return fail(address, "store into the code");
+            }
+        }
+
+        if ((opcode == Opcode::Divide || opcode == Opcode::Modulo) && Instruction::has_immediate(word) &&
+            immediate == 0) {
+            return fail(address, "division by zero");
+        }
+
+        if (opcode == Opcode::Native && (immediate >= natives.size() || !natives[immediate])) {
+            return fail(address, "native function that isn't registered");
+        }
+
+        if (address + Instruction::width(word) == code_size) {
+            reaches_end |= falls_through(opcode);
+        }
+    }
+
+    if (reaches_end && (!memory.accessible(code_size) || Instruction::opcode(memory[code_size]) != Opcode::Halt)) {
+        return fail(code_size, "runs off the end of the code");
+    }
+
+    return {};
+}
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+
+#include "memory.h"
+#include "native.h"
+
+namespace pebble {
+
+// why a program wasn't verified and the address of the instruction at fault
+struct Verification {
+    bool verified = true;
+    unsigned int address = 0;
+    const char* reason = "";
+};
+
+// the reason the instruction starting with word can never run, or nullptr if
+// it can. only the word itself is looked at, see verify for the operands
+const char* check_encoding(unsigned int word);
+
+// checks the first code_size words of memory once, so that the engines can
+// run them without checking each instruction. a verified program
+//   - has a valid opcode, form, addressing mode and registers in every instruction
+//   - has every immediate word inside the code
+//   - only jumps and calls to the start of one of its instructions
+//   - only runs off its end, or jumps there, onto a halt
+//   - only calls native functions that are registered
+//   - never divides by an immediate 0
+//   - only loads and stores absolute addresses it can access, see
+//     Memory::accessible, and never stores into its own code or the halt
+//     after it
+//
+// a program that writes into its code anyway, through the stack, a frame
+// pointer offset, a native function or a vector or block instruction, stops
+// being verified and the engines leave the rest of the run to the checked path
+//
+// frame pointer offsets, the stack and where returns and writes to ip go are
+// only known as the program runs, the fast path trusts them. divisors held in
+// registers are only known then too, but every engine checks those itself and
+// faults rather than trapping
+Verification verify(const Memory& memory, unsigned int code_size, const std::vector<NativeFunction>& natives);
+
+}
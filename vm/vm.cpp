@@ -1,218 +1,611 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
 #include "vm.h"
+#include "aot.h"
 
 namespace pebble {
 
-int unsigned_to_signed(unsigned int n) {
-    return *(int*) &n;
-}
-
-VM::VM() {
-    registers[RegisterA] = &a;
-    registers[RegisterB] = &b;
-    registers[RegisterIP] = &ip;
-    registers[RegisterSP] = &sp;
-    registers[RegisterFP] = &fp;
-}
-
-unsigned int VM::fetch() {
-    return memory[++ip];
-}
+VM::~VM() = default;
 
-template<typename T>
-T* VM::fetch_next_instruction() {
-    auto i = reinterpret_cast<T*>(memory + ip);
-    ip += sizeof(T) / 4;
-    return i;
+// the stack starts at the top of memory and grows down
+VM::VM(Engine engine, const MemoryConfig& memory) : memory(memory), engine(engine) {
+    registers[RegisterSP] = this->memory.size() - 1;
+    registers[RegisterFP] = this->memory.size() - 1;
 }
 
-void VM::push(unsigned int value) {
-    memory[sp--] = value;
+// both forms of an opcode whose immediate flag doesn't change what it does
+#define ANY_FORM(OPCODE) \
+case Opcode::OPCODE: \
+case Opcode::OPCODE | Instruction::immediate_flag
 
-}
-
-unsigned int VM::pop() {
-    return memory[++sp];
-}
+#define IMMEDIATE_FORM(OPCODE) \
+case Opcode::OPCODE | Instruction::immediate_flag
 
 #define ARITHMETIC_LOGIC_OPERATION_CASE(NAME, OPERATOR) \
-case Opcode::NAME: { \
-    auto i = fetch_next_instruction<Instruction::NAME>(); \
-    assert(i->destination < NumRegisters); \
-    if (i->source_type) { \
-        assert(i->source < NumRegisters); \
-        *registers[i->destination] = *registers[i->destination] OPERATOR *registers[i->source]; \
-    } else { \
-        *registers[i->destination] = *registers[i->destination] OPERATOR i->source; \
-    } \
+case Opcode::NAME: \
+    arithmetic_logic<Operation::NAME, false>(r, destination, source, r[RegisterIP] - Instruction::width(instruction)); \
     break; \
-}
-
-void VM::execute(unsigned int instruction) {
-    switch (instruction) {
-        case Opcode::Load: {
-            auto i = fetch_next_instruction<Instruction::Load>();
-            assert(i->destination < NumRegisters);
-
-            switch (i->source_mode) {
+IMMEDIATE_FORM(NAME): \
+    arithmetic_logic<Operation::NAME, true>(r, destination, immediate, r[RegisterIP] - Instruction::width(instruction)); \
+    break;
+
+#define VECTOR_CASE(NAME) \
+ANY_FORM(Vector##NAME):
+
+// the opcode and its immediate flag are switched on together, so every
+// (opcode, register or immediate) pair has its own case. nothing is checked
+// here, the program was either verified or check has passed the instruction
+void VM::execute(unsigned int instruction, unsigned int* r) {
+    auto immediate = fetch_immediate(instruction, r);
+    auto destination = Instruction::destination(instruction);
+    auto source = Instruction::source(instruction);
+
+    switch (instruction & (Instruction::opcode_mask | Instruction::immediate_flag)) {
+        IMMEDIATE_FORM(Load): {
+            switch (Instruction::addressing_mode(instruction)) {
                 case Opcode::AddressingModeAddress:
-                    *registers[i->destination] = memory[i->source];
+                    r[destination] = load_shared(memory[immediate]);
                     break;
                 case Opcode::AddressingModeFramePointerOffset: {
-                    auto offset = unsigned_to_signed(i->source);
-                    int address = fp + offset;
-                    *registers[i->destination] = memory[address];
+                    auto offset = unsigned_to_signed(immediate);
+                    int address = r[RegisterFP] + offset;
+                    r[destination] = load_shared(memory[address]);
                     break;
                 }
-                default:
-                    std::cerr << "vm: invalid addressing mode " << i->source_mode << "\n";
             }
 
             break;
         }
 
-        case Opcode::Store: {
-            auto i = fetch_next_instruction<Instruction::Store>();
-            assert(i->source < NumRegisters);
-
-            switch (i->destination_mode) {
+        IMMEDIATE_FORM(Store): {
+            switch (Instruction::addressing_mode(instruction)) {
                 case Opcode::AddressingModeAddress:
-                    memory[i->destination] = i->source;
+                    write(immediate, r[source]);
                     break;
                 case Opcode::AddressingModeFramePointerOffset: {
-                    auto offset = unsigned_to_signed(i->destination);
-                    int address = fp + offset;
-                    memory[address] = i->source;
+                    auto offset = unsigned_to_signed(immediate);
+                    int address = r[RegisterFP] + offset;
+                    write(address, r[source]);
                     break;
                 }
-                default:
-                    std::cerr << "vm: invalid addressing mode " << i->destination_mode << "\n";
             }
 
             break;
         }
 
-        case Opcode::Move: {
-            auto i = fetch_next_instruction<Instruction::Move>();
-            assert(i->destination < NumRegisters);
+        case Opcode::Move:
+            r[destination] = r[source];
+            break;
 
-            // 1 == register
-            if (i->source_type) {
-                assert(i->source < NumRegisters);
-                *registers[i->destination] = *registers[i->source];
-            } else {
-                *registers[i->destination] = i->source;
-            }
+        IMMEDIATE_FORM(Move):
+            r[destination] = immediate;
+            break;
+
+        ARITHMETIC_LOGIC_OPERATIONS(ARITHMETIC_LOGIC_OPERATION_CASE)
 
+        // the register form inverts the destination
+        case Opcode::Not:
+            r[destination] = ~r[destination];
             break;
-        }
 
-        ARITHMETIC_LOGIC_OPERATION_CASE(Add, +)
-        ARITHMETIC_LOGIC_OPERATION_CASE(Subtract, -)
-        ARITHMETIC_LOGIC_OPERATION_CASE(Multiply, *)
-        ARITHMETIC_LOGIC_OPERATION_CASE(Divide, /)
-        ARITHMETIC_LOGIC_OPERATION_CASE(Modulo, %)
-        ARITHMETIC_LOGIC_OPERATION_CASE(And, &)
-        ARITHMETIC_LOGIC_OPERATION_CASE(Or, |)
-        ARITHMETIC_LOGIC_OPERATION_CASE(ShiftLeft, <<)
-        ARITHMETIC_LOGIC_OPERATION_CASE(ShiftRight, >>)
-        ARITHMETIC_LOGIC_OPERATION_CASE(GreaterThan, >)
-        ARITHMETIC_LOGIC_OPERATION_CASE(GreaterThanOrEqualTo, >=)
-        ARITHMETIC_LOGIC_OPERATION_CASE(LessThan, <)
-        ARITHMETIC_LOGIC_OPERATION_CASE(LessThanOrEqualTo, <=)
-        ARITHMETIC_LOGIC_OPERATION_CASE(EqualTo, ==)
-        ARITHMETIC_LOGIC_OPERATION_CASE(NotEqualTo, !=)
-
-        case Opcode::Not: {
-            auto i = fetch_next_instruction<Instruction::Not>();
-            assert(i->destination < NumRegisters);
-            if (i->source_type) {
-                assert(i->source < NumRegisters);
-                *registers[i->destination] = ~(*registers[i->destination]);
-            } else {
-                *registers[i->destination] = ~i->source;
-            }
+        IMMEDIATE_FORM(Not):
+            r[destination] = ~immediate;
             break;
-        }
 
-        case Opcode::Jump: {
-            auto address = fetch();
-            ip = address;
+        IMMEDIATE_FORM(Jump):
+            r[RegisterIP] = immediate;
             break;
-        }
 
-        case Opcode::JumpIfZero: {
-            auto address = fetch();
-            if (a == 0) {
-                ip = address;
-            } else {
-                ip++;
+        IMMEDIATE_FORM(JumpIfZero):
+            if (r[RegisterA] == 0) {
+                r[RegisterIP] = immediate;
             }
             break;
-        }
 
-        case Opcode::JumpIfNonZero: {
-            auto address = fetch();
-            if (a != 0) {
-                ip = address;
-            } else {
-                ip++;
+        IMMEDIATE_FORM(JumpIfNonZero):
+            if (r[RegisterA] != 0) {
+                r[RegisterIP] = immediate;
             }
             break;
-        }
 
-        case Opcode::Push: {
-            auto is_register = fetch();
-            auto source = fetch();
+        case Opcode::Push:
+            push(r[source], r);
+            break;
 
-            if (is_register) {
-                push(*registers[source]);
-            } else {
-                push(source);
-            }
+        IMMEDIATE_FORM(Push):
+            push(immediate, r);
+            break;
 
-            ip++;
+        ANY_FORM(Pop): {
+            auto value = pop(r);
+            r[destination] = value;
             break;
         }
 
-        case Opcode::Pop: {
-            auto destination = fetch();
-            assert(destination < NumRegisters);
-            auto value = pop();
-            *registers[destination] = value;
-            ip++;
+        IMMEDIATE_FORM(Call):
+            push(r[RegisterIP], r);
+            r[RegisterIP] = immediate;
             break;
-        }
 
-        case Opcode::Call: {
-            auto address = fetch();
-            push(ip + 1);
-            ip = address;
+        ANY_FORM(Return): {
+            auto address = pop(r);
+            r[RegisterIP] = address;
             break;
         }
 
-        case Opcode::Return: {
-            auto address = pop();
-            ip = address;
+        IMMEDIATE_FORM(Native): {
+            NativeCall call(*this, r);
+            natives[immediate](call);
             break;
         }
 
+        VECTOR_OPERATIONS(VECTOR_CASE)
+        ANY_FORM(VectorSum):
+        ANY_FORM(VectorDot):
+            execute_vector(instruction, Instruction::has_immediate(instruction) ? immediate : r[source], r);
+            break;
+
+        ANY_FORM(Copy):
+        ANY_FORM(Fill):
+        ANY_FORM(Compare):
+            execute_block(instruction, Instruction::has_immediate(instruction) ? immediate : r[source], r);
+            break;
+
         default:
             std::cerr << "unknown instruction: " << instruction << "\n";
+            dump_trace(std::cerr);
             assert(false);
     }
 }
 
+const char* VM::check_vector(unsigned int opcode, unsigned int count, const unsigned int* r) const {
+    if (!memory.accessible(r[RegisterA], count) ||
+        (opcode != Opcode::VectorSum && !memory.accessible(r[RegisterB], count))) {
+        return "vector outside memory";
+    }
+    return nullptr;
+}
+
+#define VECTOR_OPERATION_CASE(NAME) \
+case Opcode::Vector##NAME: \
+    vector_combine(VectorOperation::NAME, memory.data() + x, memory.data() + y, count); \
+    break;
+
+// checked even on the fast path, a run of words is too far from its address
+// for the guard page to catch and the check is nothing next to the work
+void VM::execute_vector(unsigned int instruction, unsigned int count, unsigned int* r) {
+    auto opcode = Instruction::opcode(instruction);
+    if (auto reason = check_vector(opcode, count, r)) {
+        fault(reason, r[RegisterIP] - Instruction::width(instruction));
+    }
+
+    auto x = r[RegisterA];
+    auto y = r[RegisterB];
+    switch (opcode) {
+        VECTOR_OPERATIONS(VECTOR_OPERATION_CASE)
+        case Opcode::VectorSum:
+            r[RegisterA] = vector_sum(memory.data() + x, count);
+            return;
+        case Opcode::VectorDot:
+            r[RegisterA] = vector_dot(memory.data() + x, memory.data() + y, count);
+            return;
+    }
+
+    // the kernels write straight to memory. a run that reaches the code stops
+    // the program being verified, which ends the fast path, see VM::run
+    invalidate(x, count);
+    assert(count == 0 || x > code_size || !verification.verified);
+}
+
+#undef VECTOR_OPERATION_CASE
 
-void VM::load(std::vector<unsigned int> instructions) {
-    for (int i = 0; i < instructions.size(); i++) {
-        memory[i] = instructions[i];
+const char* VM::check_block(unsigned int opcode, unsigned int count, const unsigned int* r) const {
+    if (!memory.accessible(r[RegisterA], count) ||
+        (opcode != Opcode::Fill && !memory.accessible(r[RegisterB], count))) {
+        return "block outside memory";
     }
+    return nullptr;
 }
 
-void VM::run() {
-    while (memory[ip] != Opcode::Halt) {
-        execute(memory[ip]);
+// bounds are checked once for the whole block, as for the vector instructions
+void VM::execute_block(unsigned int instruction, unsigned int count, unsigned int* r) {
+    auto opcode = Instruction::opcode(instruction);
+    if (auto reason = check_block(opcode, count, r)) {
+        fault(reason, r[RegisterIP] - Instruction::width(instruction));
     }
-};
+
+    auto x = memory.data() + r[RegisterA];
+    auto y = memory.data() + r[RegisterB];
+    switch (opcode) {
+        // the blocks may overlap, the copy is as if through a buffer
+        case Opcode::Copy:
+            std::memmove(x, y, count * sizeof(unsigned int));
+            break;
+        case Opcode::Fill:
+            std::fill_n(x, count, r[RegisterB]);
+            break;
+        // a is 0 if the blocks are equal, otherwise 1 or -1 as the first word
+        // that differs is greater or less in the block at a, unsigned
+        case Opcode::Compare: {
+            auto [i, j] = std::mismatch(x, x + count, y);
+            r[RegisterA] = i == x + count ? 0 : *i > *j ? 1 : -1;
+            return;
+        }
+    }
+
+    // as for the vector instructions, a block that reaches the code ends the fast path
+    invalidate(r[RegisterA], count);
+    assert(count == 0 || r[RegisterA] > code_size || !verification.verified);
+}
+
+void VM::fault(const char* reason, unsigned int address) const {
+#ifdef PEBBLE_GUARD_PAGES
+    GuardedRun::fault(reason, address);
+#else
+    std::cerr << "vm: " << reason << " at " << address << "\n";
+    dump_trace(std::cerr);
+    std::abort();
+#endif
+}
+
+void VM::invalidate(unsigned int address, unsigned int count) {
+    auto end = std::min<unsigned long long>(address + static_cast<unsigned long long>(count), code_size + 1ull);
+    for (unsigned long long i = address; i < end; i++) {
+        invalidate(i);
+    }
+}
+
+void VM::invalidate(unsigned int address) {
+    if (verification.verified) {
+        verification = Verification{.verified = false, .address = address, .reason = "wrote into the code"};
+    }
+
+    // nothing is decoded or compiled from the halt
+    if (address == code_size) {
+        return;
+    }
+
+    auto first = address < max_record_span ? 0 : address - max_record_span + 1;
+    for (auto i = first; i <= address; i++) {
+        decoded[i].handler = Handler::Undecoded;
+    }
+
+#ifdef PEBBLE_JIT_ENABLED
+    if (jit) {
+        jit->invalidate(address);
+    }
+#endif
+}
+
+void VM::decode_record(unsigned int address) {
+    auto record = decode(memory.data(), address, code_size);
+    auto next = address + record.width;
+
+    if (next < code_size) {
+        if (decoded[next].handler == Handler::Undecoded) {
+            decoded[next] = decode(memory.data(), next, code_size);
+        }
+        record.handler = fuse(record.handler, unfused(decoded[next].handler));
+    }
+
+    decoded[address] = record;
+}
+
+void VM::load(const std::vector<unsigned int>& instructions, const DataSection& data) {
+    assert(instructions.size() <= memory.size());
+    assert(data.empty() || (data.address() > instructions.size() &&
+                            data.address() + static_cast<unsigned long long>(data.words().size()) <= memory.size()));
+
+    memory.load(0, instructions.data(), instructions.size());
+    memory.load(data.address(), data.words().data(), data.words().size());
+    code_size = instructions.size();
+    faulted = false;
+    decode_program();
+}
+
+bool VM::load(const Image& image) {
+    // the sizes come from a file, so they're checked against this VM's memory.
+    // the code needs room for the halt it runs off onto as well
+    auto& header = image.header();
+    if (!memory.accessible(0, header.code_size + 1ull)) {
+        std::cerr << "vm: the image's " << header.code_size << " words of code don't fit in memory\n";
+        return false;
+    }
+    if (header.data_size > 0 && (header.data_address <= header.code_size ||
+                                 !memory.accessible(header.data_address, header.data_size))) {
+        std::cerr << "vm: the image's data at " << header.data_address << " overlaps the code or doesn't fit in memory\n";
+        return false;
+    }
+
+    memory.load(0, image.code(), header.code_size, image.descriptor(), header.code_offset);
+    memory.load(header.data_address, image.data(), header.data_size, image.descriptor(), header.data_offset);
+    code_size = header.code_size;
+    faulted = false;
+    decode_program();
+    return true;
+}
+
+void VM::load(AotState& state) {
+    registers[RegisterA] = state.a;
+    registers[RegisterB] = state.b;
+    registers[RegisterIP] = state.ip;
+    registers[RegisterSP] = state.sp;
+    registers[RegisterFP] = state.fp;
+    std::swap(memory, state.memory);
+    std::swap(natives, state.natives);
+
+    code_size = state.code_size;
+    faulted = false;
+    decode_program();
+}
+
+void VM::save(AotState& state) {
+    state.a = registers[RegisterA];
+    state.b = registers[RegisterB];
+    state.ip = registers[RegisterIP];
+    state.sp = registers[RegisterSP];
+    state.fp = registers[RegisterFP];
+    std::swap(memory, state.memory);
+    std::swap(natives, state.natives);
+    state.code_size = code_size;
+}
+
+void VM::register_native(unsigned int index, NativeFunction function) {
+    assert(function);
+    if (index >= natives.size()) {
+        natives.resize(index + 1);
+    }
+    natives[index] = std::move(function);
+
+    // the program may have been loaded waiting for it
+    if (!verification.verified) {
+        verification = verify(memory, code_size, natives);
+    }
+}
+
+Ring VM::map_ring(unsigned int address, unsigned int capacity) {
+    assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    assert(address >= code_size && memory.accessible(address, ring_header_size + static_cast<unsigned long long>(capacity)));
+
+    auto header = memory.data() + address;
+    std::fill(header, header + ring_header_size, 0);
+    header[ring_capacity_offset] = capacity;
+    return Ring(header, capacity);
+}
+
+void VM::decode_program() {
+    verification = verify(memory, code_size, natives);
+
+    decoded.assign(code_size + 1, DecodedInstruction{.handler = Handler::Undecoded, .width = 1});
+    decoded[code_size].handler = Handler::OutOfCode;
+
+    for (unsigned int address = 0; address < code_size; address += decoded[address].width) {
+        decode_record(address);
+    }
+
+    reset_jit();
+}
+
+void VM::reset_jit() {
+#ifdef PEBBLE_JIT_ENABLED
+    if (engine == Engine::Jit) {
+        jit = std::make_unique<Jit>(code_size);
+    }
+#endif
+}
+
+// records are invalidated as their words are written, so the ones decoded so
+// far still match memory and can be taken along
+std::shared_ptr<const Snapshot> VM::snapshot() const {
+    auto snapshot = std::make_shared<Snapshot>(memory);
+    std::copy(registers, registers + NumRegisters, snapshot->registers);
+    snapshot->code_size = code_size;
+    snapshot->verification = verification;
+    snapshot->faulted = faulted;
+    snapshot->decoded = decoded;
+    snapshot->natives = natives;
+    return snapshot;
+}
+
+void VM::restore(const Snapshot& snapshot) {
+    std::copy(snapshot.registers, snapshot.registers + NumRegisters, registers);
+    memory = Memory(snapshot.memory);
+    code_size = snapshot.code_size;
+    verification = snapshot.verification;
+    faulted = snapshot.faulted;
+    decoded = snapshot.decoded;
+    natives = snapshot.natives;
+    reset_jit();
+}
+
+std::unique_ptr<VM> VM::fork() const {
+    // the memory is replaced straight away
+    auto vm = std::make_unique<VM>(engine, MemoryConfig{.size = 1});
+    vm->restore(*snapshot());
+    return vm;
+}
+
+// checks the budget on every instruction, there's no block structure to go by
+RunStatus VM::run_switch(long long& fuel) {
+    unsigned int r[NumRegisters];
+    std::copy(registers, registers + NumRegisters, r);
+
+    auto status = RunStatus::Halted;
+    while (Instruction::opcode(memory[r[RegisterIP]]) != Opcode::Halt) {
+        if (fuel <= 0 || !verification.verified) {
+            status = RunStatus::OutOfFuel;
+            break;
+        }
+
+        auto instruction = memory[r[RegisterIP]];
+        fuel -= Instruction::width(instruction);
+        trace_instruction(r[RegisterIP], r);
+        execute(instruction, r);
+    }
+
+    std::copy(r, r + NumRegisters, registers);
+    return status;
+}
+
+const char* VM::check(const unsigned int* r) const {
+    auto ip = r[RegisterIP];
+    if (!memory.accessible(ip)) {
+        return "ip outside memory";
+    }
+
+    auto instruction = memory[ip];
+    auto opcode = Instruction::opcode(instruction);
+    // halts end the run rather than being run
+    if (opcode == Opcode::Halt) {
+        return nullptr;
+    }
+
+    if (auto reason = check_encoding(instruction)) {
+        return reason;
+    }
+    if (Instruction::has_immediate(instruction) && !memory.accessible(ip + 1ull)) {
+        return "immediate outside memory";
+    }
+
+    auto immediate = Instruction::has_immediate(instruction) ? memory[ip + 1] : 0;
+    // addresses wrap the same way they do in execute
+    unsigned int address;
+    switch (opcode) {
+        case Opcode::Load:
+        case Opcode::Store:
+            address = Instruction::addressing_mode(instruction) == Opcode::AddressingModeFramePointerOffset ?
+                      r[RegisterFP] + immediate : immediate;
+            return memory.accessible(address) ? nullptr : "load or store outside memory";
+        case Opcode::Divide:
+        case Opcode::Modulo:
+            return (Instruction::has_immediate(instruction) ? immediate : r[Instruction::source(instruction)]) != 0 ?
+                   nullptr : "division by zero";
+        case Opcode::Push:
+        case Opcode::Call:
+            return memory.accessible(r[RegisterSP]) ? nullptr : "stack overflow";
+        case Opcode::Pop:
+        case Opcode::Return:
+            address = r[RegisterSP] + 1;
+            return memory.accessible(address) ? nullptr : "pop outside memory";
+        case Opcode::Native:
+            return immediate < natives.size() && natives[immediate] ? nullptr : "native function that isn't registered";
+        case Opcode::VectorAdd:
+        case Opcode::VectorSubtract:
+        case Opcode::VectorMultiply:
+        case Opcode::VectorMinimum:
+        case Opcode::VectorMaximum:
+        case Opcode::VectorSum:
+        case Opcode::VectorDot:
+            return check_vector(opcode, Instruction::has_immediate(instruction) ? immediate : r[Instruction::source(instruction)], r);
+        case Opcode::Copy:
+        case Opcode::Fill:
+        case Opcode::Compare:
+            return check_block(opcode, Instruction::has_immediate(instruction) ? immediate : r[Instruction::source(instruction)], r);
+        default:
+            return nullptr;
+    }
+}
+
+void VM::report_fault(const char* reason, const unsigned int* r) const {
+    std::cerr << "vm: " << reason << " at " << r[RegisterIP] << "\n";
+    dump_trace(std::cerr);
+}
+
+// the same as run_switch with check run first on every instruction
+RunStatus VM::run_checked(long long fuel) {
+    unsigned int r[NumRegisters];
+    std::copy(registers, registers + NumRegisters, r);
+
+    auto status = RunStatus::Halted;
+    while (true) {
+        if (auto reason = check(r)) {
+            report_fault(reason, r);
+            status = RunStatus::Faulted;
+            break;
+        }
+
+        auto instruction = memory[r[RegisterIP]];
+        if (Instruction::opcode(instruction) == Opcode::Halt) {
+            break;
+        }
+        if (fuel <= 0) {
+            status = RunStatus::OutOfFuel;
+            break;
+        }
+
+        fuel -= Instruction::width(instruction);
+        trace_instruction(r[RegisterIP], r);
+        execute(instruction, r);
+    }
+
+    std::copy(r, r + NumRegisters, registers);
+    return status;
+}
+
+void VM::dump_trace(std::ostream& out) const {
+    trace.write(out);
+}
+
+RunStatus VM::run(unsigned long long budget) {
+    // the engines count down and stop at zero or below
+    auto fuel = static_cast<long long>(std::min<unsigned long long>(budget, LLONG_MAX));
+
+    if (faulted) {
+        return RunStatus::Faulted;
+    }
+
+    // the engines keep the registers to themselves while they run, and one
+    // that faults jumps out of the middle of an instruction without handing
+    // them back, so every fault goes back to these instead
+    std::copy(registers, registers + NumRegisters, run_start);
+
+#ifdef PEBBLE_GUARD_PAGES
+    // a program running into the stack's guard page lands back here, see fault
+    GuardedRun guarded(memory);
+    if (sigsetjmp(guarded.jump, 0)) {
+        std::cerr << "vm: " << guarded.reason << " at " << guarded.address << "\n";
+        dump_trace(std::cerr);
+        return stop_faulted();
+    }
+#endif
+
+    if (!verification.verified) {
+        return finish_checked(fuel);
+    }
+
+    auto status = RunStatus::Halted;
+    switch (engine) {
+        case Engine::Switch:
+            status = run_switch(fuel);
+            break;
+        case Engine::Threaded:
+            status = run_threaded(fuel);
+            break;
+        case Engine::Jit:
+            status = run_jit(fuel);
+            break;
+    }
+
+    // the program wrote into its code, which may now do anything, so the
+    // rest of the run is checked
+    if (status == RunStatus::OutOfFuel && fuel > 0 && !verification.verified) {
+        return finish_checked(fuel);
+    }
+    return status;
+}
+
+RunStatus VM::finish_checked(long long fuel) {
+    auto status = run_checked(fuel);
+    return status == RunStatus::Faulted ? stop_faulted() : status;
+}
+
+RunStatus VM::stop_faulted() {
+    std::copy(run_start, run_start + NumRegisters, registers);
+    faulted = true;
+    return RunStatus::Faulted;
+}
 
 }
\ No newline at end of file
@@ -1,13 +1,29 @@
 #pragma once
 
+#include <cassert>
+#include <climits>
 #include <iostream>
+#include <memory>
+#include <type_traits>
 #include <vector>
 
 #include "opcode.h"
 #include "instruction.h"
+#include "decoder.h"
+#include "ngram.h"
+#include "jit.h"
+#include "memory.h"
+#include "trace.h"
+#include "image.h"
+#include "native.h"
+#include "ring.h"
+#include "vector.h"
+#include "verifier.h"
 
 namespace pebble {
 
+struct AotState;
+
 enum Register {
     RegisterA,
     RegisterB,
@@ -17,31 +33,262 @@ enum Register {
     NumRegisters
 };
 
-const unsigned int memory_size = 80;
+enum class Engine {
+    // decodes straight from memory on every instruction
+    Switch,
+    // runs from records decoded once at load time
+    Threaded,
+    // compiles to x86-64 where possible, the same as Threaded where the JIT isn't built
+    Jit
+};
+
+#ifdef PEBBLE_THREADED_DISPATCH
+const Engine default_engine = Engine::Threaded;
+#else
+const Engine default_engine = Engine::Switch;
+#endif
+
+enum class RunStatus {
+    Halted,
+    // the budget given to run was used up, running again carries on from where it stopped
+    OutOfFuel,
+    // the program did something the checked path caught or the engines fault
+    // on, see VM::run
+    Faulted
+};
+
+const unsigned long long unlimited_fuel = ULLONG_MAX;
+
+// the state of a VM that others can be started from, see VM::snapshot
+struct Snapshot {
+    unsigned int registers[NumRegisters] = {};
+    unsigned int code_size = 0;
+    Verification verification;
+    bool faulted = false;
+    std::vector<DecodedInstruction> decoded;
+    std::vector<NativeFunction> natives;
+    MemoryImage memory;
+
+    explicit Snapshot(const Memory& memory) : memory(memory) {}
+};
+
+inline int unsigned_to_signed(unsigned int n) {
+    return *(int*) &n;
+}
 
 class VM {
-    unsigned int a = 0;
-    unsigned int b = 0;
-    unsigned int ip = 0;
-    unsigned int sp = memory_size - 1;
-    unsigned int fp = memory_size - 1;
-    unsigned int memory[memory_size];
-    unsigned int* registers[5];
+    // indexed by Register, the run loops work on a copy in a local array and
+    // write it back when they return
+    unsigned int registers[NumRegisters] = {};
+    // the registers as run was called, which a run that faults leaves them at
+    unsigned int run_start[NumRegisters] = {};
+    Memory memory;
+    Engine engine;
+    // set once a run faults, until the next load or restore, see run
+    bool faulted = false;
+
+    unsigned int code_size = 0;
+    // whether the engines can run the program without checking it, see verifier.h
+    Verification verification;
+    // one record per word of the loaded program plus an OutOfCode sentinel
+    std::vector<DecodedInstruction> decoded;
+    std::unique_ptr<Jit> jit;
+    Trace<trace_size> trace;
+    // indexed by the operand of native, empty where nothing is registered
+    std::vector<NativeFunction> natives;
+
+    void trace_instruction(unsigned int ip, const unsigned int* r) {
+        if constexpr (trace_size > 0) {
+            trace.record(ip, memory[ip], r[RegisterA], r[RegisterB], r[RegisterSP]);
+        }
+    }
+
+    // verifies and decodes the first code_size words of memory, see load
+    void decode_program();
+    // drops anything compiled from the old code
+    void reset_jit();
+    void invalidate(unsigned int address);
+    // the words of [address, address + count) that are code or its halt
+    void invalidate(unsigned int address, unsigned int count);
+    // decodes the record at address, fused with the next instruction where possible
+    void decode_record(unsigned int address);
+
+    // the halt the code runs off onto is verified along with it
+    void write(unsigned int address, unsigned int value) {
+        store_shared(memory[address], value);
+        if (address <= code_size) {
+            invalidate(address);
+        }
+    }
+
+    void push(unsigned int value, unsigned int* r) {
+        write(r[RegisterSP]--, value);
+    }
+
+    unsigned int pop(unsigned int* r) {
+        return memory[++r[RegisterSP]];
+    }
+
+    // moves ip past the instruction starting with word, returning its immediate if it has one
+    unsigned int fetch_immediate(unsigned int word, unsigned int* r) {
+        auto immediate = Instruction::has_immediate(word) ? memory[r[RegisterIP] + 1] : 0;
+        r[RegisterIP] += Instruction::width(word);
+        return immediate;
+    }
 
-    unsigned int fetch();
-    void push(unsigned int value);
-    unsigned int pop();
+    // one instance per operation and operand kind, shared by the engines.
+    // divisions fault on a zero divisor, address being the instruction's
+    template<typename Operation, bool Immediate>
+    void arithmetic_logic(unsigned int* r, unsigned int destination, unsigned int source, unsigned int address) const {
+        auto right = Immediate ? source : r[source];
+        if constexpr (std::is_same_v<Operation, pebble::Operation::Divide> ||
+                      std::is_same_v<Operation, pebble::Operation::Modulo>) {
+            if (right == 0) {
+                fault("division by zero", address);
+            }
+        }
+        r[destination] = Operation::apply(r[destination], right);
+    }
 
-    void execute(unsigned int instruction);
+    // runs the instruction at r[RegisterIP] on the register file r
+    void execute(unsigned int instruction, unsigned int* r);
+    // the reason a vector instruction would go outside memory, or nullptr
+    const char* check_vector(unsigned int opcode, unsigned int count, const unsigned int* r) const;
+    void execute_vector(unsigned int instruction, unsigned int count, unsigned int* r);
+    // the same for copy, fill and compare
+    const char* check_block(unsigned int opcode, unsigned int count, const unsigned int* r) const;
+    void execute_block(unsigned int instruction, unsigned int count, unsigned int* r);
+    // stops the run from inside an engine, see GuardedRun::fault
+    [[noreturn]] void fault(const char* reason, unsigned int address) const;
+    // the engines count fuel down and return once it's used up, an instruction
+    // costs its width in words. they also return OutOfFuel, with fuel left, once
+    // a write into the code means the program isn't verified any more, see run
+    RunStatus run_switch(long long& fuel);
 
-    template<typename T>
+    // the reason running the instruction at r[RegisterIP] would go outside
+    // memory or can't be done, or nullptr if it can be run
+    const char* check(const unsigned int* r) const;
+    void report_fault(const char* reason, const unsigned int* r) const;
+    // checks every instruction before running it, for programs that weren't verified
+    RunStatus run_checked(long long fuel);
+    // run_checked for the rest of a run, stopping the same as any fault if it faults
+    RunStatus finish_checked(long long fuel);
+    // puts the registers back as the run started and refuses any further run, see run
+    RunStatus stop_faulted();
 
-    T* fetch_next_instruction();
+    // runs a sequential handler and moves pc past it, see threaded.cpp
+    template<Handler H>
+    void step(const DecodedInstruction* i, unsigned int& pc, unsigned int* r);
+
+    // runs from the decoded records, see threaded.cpp
+    RunStatus run_threaded(long long& fuel);
+    // runs compiled blocks and interprets the rest, see jit.cpp
+    RunStatus run_jit(long long& fuel);
+
+    friend class Jit;
+    friend class Profiler;
+    friend class NativeCall;
 
 public:
-    VM();
-    void load(std::vector<unsigned int> instructions);
-    void run();
+    VM(Engine engine = default_engine, const MemoryConfig& memory = {});
+    ~VM();
+    // data, see Assembler::data, is put in memory along with the code
+    void load(const std::vector<unsigned int>& instructions, const DataSection& data = {});
+    // maps the image's code and data into memory where the host allows, so
+    // nothing is read until it runs. false with the reason on stderr if they
+    // don't fit in memory, leaving the VM as it was
+    bool load(const Image& image);
+    // takes over the registers and memory of a translated program and hands
+    // them back, see aot.h
+    void load(AotState& state);
+    void save(AotState& state);
+
+    // native <index> calls function from then on, programs that call an index
+    // nothing is registered at aren't verified. snapshots take the functions
+    // along with the program
+    void register_native(unsigned int index, NativeFunction function);
+
+    // clears a ring with capacity slots, a power of two, at address in memory
+    // and returns the host's end of it, see ring.h. the host can use it from
+    // any one thread while the program runs, but setting it up has to happen
+    // while the program isn't running. where it is is up to the host and the
+    // program to agree on, it can't overlap the code
+    Ring map_ring(unsigned int address, unsigned int capacity);
+
+    // copies the registers and memory, memory only as far as the program has
+    // written to it. VMs restored from the snapshot share its pages until they write to them
+    std::shared_ptr<const Snapshot> snapshot() const;
+    // carries on from the snapshot with this VM's engine
+    void restore(const Snapshot& snapshot);
+    // a new VM with the same engine, carrying on from where this one is.
+    // restoring from one snapshot is cheaper when starting many
+    std::unique_ptr<VM> fork() const;
+    // runs until the program halts or has used about fuel, which is counted in
+    // words rather than instructions, each instruction costing its width. the
+    // budget is only checked at the end of basic blocks so one block can run past it.
+    // programs that weren't verified run on the switch engine with every
+    // instruction checked, and stop with Faulted instead of crashing. so does
+    // the rest of the run once a verified program writes into its code. any
+    // program stops with Faulted when the stack overflows onto its guard page,
+    // see MemoryConfig::stack_size, divides by zero or runs a vector or block
+    // instruction outside memory.
+    //
+    // whichever engine it was on and whatever the fault, a run that faults
+    // leaves the registers as they were when it was called, while memory keeps
+    // whatever the program wrote before the fault. the VM can't carry on from
+    // there, every later run returns Faulted straight away until the next load
+    // or restore
+    RunStatus run(unsigned long long fuel = unlimited_fuel);
+    // writes the last instructions run, oldest first, when built with a
+    // PEBBLE_TRACE_SIZE. the JIT only records the first instruction of each block
+    void dump_trace(std::ostream& out) const;
+
+    // whether the loaded program was verified, it stops being once it writes into its code
+    const Verification& verified() const {
+        return verification;
+    }
+
+    // runs on the switch engine, counting which handlers run back to back, see ngram.cpp
+    void run_profiled(NgramProfile& profile);
+};
+
+// what a native function sees of the VM calling it, valid until it returns
+class NativeCall {
+    VM& vm;
+    unsigned int* r;
+
+public:
+    NativeCall(VM& vm, unsigned int* r) : vm(vm), r(r) {}
+
+    unsigned int& a() {
+        return r[RegisterA];
+    }
+
+    unsigned int& b() {
+        return r[RegisterB];
+    }
+
+    // the nth word on the stack, 0 being the one pushed last. the program pops
+    // its arguments itself once the call returns
+    unsigned int argument(unsigned int n) const {
+        return load(r[RegisterSP] + 1 + n);
+    }
+
+    // for buffers the program passes by address, see Memory::accessible
+    bool accessible(unsigned int address) const {
+        return vm.memory.accessible(address);
+    }
+
+    unsigned int load(unsigned int address) const {
+        assert(accessible(address));
+        return vm.memory[address];
+    }
+
+    // stores into the program are seen by the engines the same as the program's own
+    void store(unsigned int address, unsigned int value) {
+        assert(accessible(address));
+        vm.write(address, value);
+    }
 };
 
-}
\ No newline at end of file
+}